@@ -0,0 +1,144 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Timing and reporting shared by the benchmark tools.
+ */
+
+#include <kdecoration_p.h>
+#include <tdeconfig.h>
+#include <tqtextstream.h>
+#include <tqtl.h>
+
+#include <math.h>
+
+#include "benchutil.h"
+
+namespace BlueCurve {
+
+// Nearest rank on the sorted samples
+static double percentile( const TQValueVector<double>& samples, int p )
+{
+	int n = samples.size();
+	int rank = (int) ceil( p / 100.0 * n );
+	return samples[TQMAX( rank, 1 ) - 1];
+}
+
+
+BenchResult summarize( const TQString& name, const TQString& params,
+	TQValueVector<double>& samples )
+{
+	qHeapSort( samples );
+
+	double sum = 0;
+	for ( unsigned int i = 0; i < samples.size(); i++ )
+		sum += samples[i];
+
+	BenchResult r;
+	r.name = name;
+	r.params = params;
+	r.samples = samples.size();
+	r.min = samples.first();
+	r.p50 = percentile( samples, 50 );
+	r.p90 = percentile( samples, 90 );
+	r.p99 = percentile( samples, 99 );
+	r.max = samples.last();
+	r.mean = sum / samples.size();
+	return r;
+}
+
+
+double elapsedUs( const timespec& start )
+{
+	timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (now.tv_sec - start.tv_sec) * 1e6
+		+ (now.tv_nsec - start.tv_nsec) / 1e3;
+}
+
+
+void writeJson( TQTextStream& out, const char* benchmark,
+	const TQString& header, const BenchResults& results,
+	const BenchCounters& counters )
+{
+	out << "{\n";
+	out << "  \"benchmark\": \"" << benchmark << "\",\n";
+	out << header;
+	if ( !counters.isEmpty() )
+	{
+		out << "  \"counters\": { ";
+		BenchCounters::ConstIterator c;
+		for ( c = counters.begin(); c != counters.end(); ++c )
+		{
+			if ( c != counters.begin() )
+				out << ", ";
+			out << "\"" << (*c).name << "\": " << (*c).value;
+		}
+		out << " },\n";
+	}
+	out << "  \"unit\": \"us\",\n";
+	out << "  \"results\": [\n";
+
+	BenchResults::ConstIterator it;
+	for ( it = results.begin(); it != results.end(); ++it )
+	{
+		const BenchResult& r = *it;
+		out << "    { \"name\": \"" << r.name << "\", \"params\": \"" << r.params
+			<< "\", \"samples\": " << r.samples
+			<< ", \"min\": " << r.min << ", \"p50\": " << r.p50
+			<< ", \"p90\": " << r.p90 << ", \"p99\": " << r.p99
+			<< ", \"max\": " << r.max << ", \"mean\": " << r.mean << " }";
+		if ( it != results.fromLast() )
+			out << ",";
+		out << "\n";
+	}
+
+	out << "  ]\n";
+	out << "}\n";
+}
+
+
+void writeCsv( TQTextStream& out, const BenchResults& results,
+	const BenchCounters& counters )
+{
+	out << "name,params,samples,min,p50,p90,p99,max,mean\n";
+
+	BenchResults::ConstIterator it;
+	for ( it = results.begin(); it != results.end(); ++it )
+	{
+		const BenchResult& r = *it;
+		out << r.name << "," << r.params << "," << r.samples << ","
+			<< r.min << "," << r.p50 << "," << r.p90 << "," << r.p99 << ","
+			<< r.max << "," << r.mean << "\n";
+	}
+
+	BenchCounters::ConstIterator c;
+	for ( c = counters.begin(); c != counters.end(); ++c )
+		out << (*c).name << ",," << (*c).value << ",,,,,,\n";
+}
+
+
+// KDecorationOptions leaves its settings to the subclass, like the
+// preview in the kcm does
+BenchOptions::BenchOptions()
+{
+	d = new KDecorationOptionsPrivate;
+	d->defaultKWinSettings();
+	updateSettings();
+}
+
+
+BenchOptions::~BenchOptions()
+{
+	delete d;
+}
+
+
+unsigned long BenchOptions::updateSettings()
+{
+	TDEConfig config( "twinrc", true );
+	return d->updateKWinSettings( &config );
+}
+
+}
+
+// vim: ts=4
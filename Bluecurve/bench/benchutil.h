@@ -0,0 +1,68 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Timing and reporting shared by the benchmark tools.
+ */
+
+#ifndef _BLUECURVE_BENCHUTIL_H
+#define _BLUECURVE_BENCHUTIL_H
+
+#include <tqstring.h>
+#include <tqvaluelist.h>
+#include <tqvaluevector.h>
+#include <kdecoration.h>
+
+#include <time.h>
+
+class TQTextStream;
+
+namespace BlueCurve {
+
+// Percentiles of a set of timings, in microseconds
+struct BenchResult
+{
+	TQString name;
+	TQString params;
+	unsigned int samples;
+	double min, p50, p90, p99, max, mean;
+};
+
+typedef TQValueList<BenchResult> BenchResults;
+
+// An event count taken over a whole run, like cache hits
+struct BenchCounter
+{
+	TQString name;
+	unsigned long value;
+};
+
+typedef TQValueList<BenchCounter> BenchCounters;
+
+// Sorts samples and summarizes them, samples must not be empty
+BenchResult summarize( const TQString& name, const TQString& params,
+	TQValueVector<double>& samples );
+
+// Microseconds since start, on the monotonic clock
+double elapsedUs( const timespec& start );
+
+// Writes results as JSON, with the run parameters as header fields. In
+// CSV the counters are rows with their value in the samples column.
+void writeJson( TQTextStream& out, const char* benchmark,
+	const TQString& header, const BenchResults& results,
+	const BenchCounters& counters = BenchCounters() );
+void writeCsv( TQTextStream& out, const BenchResults& results,
+	const BenchCounters& counters = BenchCounters() );
+
+// The decoration options as twin sets them up, from twinrc
+class BenchOptions : public KDecorationOptions
+{
+	public:
+		BenchOptions();
+		virtual ~BenchOptions();
+		virtual unsigned long updateSettings();
+};
+
+}
+
+#endif
+// vim: ts=4
@@ -0,0 +1,447 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Benchmarks for the decoration's pixmap creation and paint paths.
+ *
+ *	Runs against any X server, Xvfb will do:
+ *
+ *		xvfb-run ./bluecurve-bench --iterations 500 > bench.json
+ *
+ *	Every benchmark is run for a number of warmup rounds, then timed per
+ *	iteration. The results are written as JSON, or CSV with --csv, with
+ *	the percentiles of the iteration times in microseconds.
+ */
+
+#include <tdeapplication.h>
+#include <tdecmdlineargs.h>
+#include <tdelocale.h>
+#include <tqfile.h>
+#include <tqpainter.h>
+#include <tqtextstream.h>
+#include <tqvaluevector.h>
+#include <tqwidget.h>
+
+#include <time.h>
+
+#include "bluecurveclient.h"
+#include "bluecurvecache.h"
+#include "bluecurverecolor.h"
+#include "bluecurverenderer.h"
+#include "benchutil.h"
+
+using namespace BlueCurve;
+
+namespace BlueCurve {
+extern GradientCache* gradientCache;
+}
+
+static int iterations = 200;
+static int warmup = 10;
+
+static BenchResults results;
+
+
+/*
+ * Times the body of a loop, once per iteration:
+ *
+ *	Sampler s( "name", "params" );
+ *	while ( s.next() )
+ *		...
+ *
+ * The X server is synced before every sample is taken, so the time spent
+ * there is included.
+ */
+class Sampler
+{
+	public:
+		Sampler( const char* name, const TQString& params = TQString::null )
+			: m_name( name ), m_params( params ), m_run( -1 )
+		{
+			m_samples.reserve( iterations );
+		}
+
+		bool next()
+		{
+			if ( m_run >= 0 )
+			{
+				tqApp->syncX();
+				if ( m_run >= warmup )
+					m_samples.push_back( elapsedUs( m_start ) );
+			}
+
+			if ( ++m_run >= warmup + iterations )
+			{
+				finish();
+				return false;
+			}
+
+			clock_gettime( CLOCK_MONOTONIC, &m_start );
+			return true;
+		}
+
+	private:
+		void finish()
+		{
+			results.append( summarize( m_name, m_params, m_samples ) );
+		}
+
+		TQString m_name;
+		TQString m_params;
+		TQValueVector<double> m_samples;
+		timespec m_start;
+		int m_run;
+};
+
+
+// A normal window with the default button layout, a menu button on the
+// left and help, minimize, maximize and close on the right. The buttons
+// are windowless, so painting the titlebar includes them.
+static DecorationState windowState( int w, int h, int border, int grabBorder,
+		bool active )
+{
+	static const int rightGlyphs[] = { GlyphHelp, GlyphIconify,
+		GlyphMaximize, GlyphClose };
+
+	DecorationState s;
+	s.size = TQSize( w, h );
+	s.caption = "bluecurve-bench - a window caption of typical length";
+	s.active = active;
+	s.tool = false;
+	s.titleHeight = BASE_BUTTON_SIZE;
+	s.client = TQRect( border, BASE_BUTTON_SIZE + 4, w - 2*border,
+		h - BASE_BUTTON_SIZE - 4 - grabBorder );
+	s.font = DecorationRenderer::titleFont( false );
+	s.readOptions();
+
+	int state = active ? AtlasActive : 0;
+
+	DecorationButton menu;
+	menu.rect = TQRect( 2, TOP_GRABBAR_WIDTH, BASE_BUTTON_SIZE, BASE_BUTTON_SIZE );
+	menu.glyph = GlyphMenu;
+	menu.pos = LeftButtonRight;
+	menu.state = state;
+	menu.paint = true;
+	s.buttons.append( menu );
+
+	int x = w - 2 - 4*BASE_BUTTON_SIZE - 3*2;
+	s.titleRect = TQRect( 2 + BASE_BUTTON_SIZE, TOP_GRABBAR_WIDTH,
+		x - 2 - 2 - BASE_BUTTON_SIZE, BASE_BUTTON_SIZE );
+	for ( int i = 0; i < 4; i++ )
+	{
+		DecorationButton b;
+		b.rect = TQRect( x, TOP_GRABBAR_WIDTH, BASE_BUTTON_SIZE, BASE_BUTTON_SIZE );
+		b.glyph = rightGlyphs[i];
+		b.pos = (i == 3) ? ButtonRight : ButtonMid;
+		b.state = state;
+		b.paint = true;
+		s.buttons.append( b );
+		x += BASE_BUTTON_SIZE + 2;
+	}
+
+	return s;
+}
+
+
+// Reads the configuration and creates all pixmaps. Only one handler may
+// exist at a time, they share the pixmaps.
+static void benchHandlerCreate()
+{
+	Sampler s( "handler_create" );
+	while ( s.next() )
+		delete new BlueCurveHandler();
+}
+
+
+// Recreates every pixmap which depends on the colors
+static void benchHandlerReset( BlueCurveHandler* handler )
+{
+	Sampler s( "handler_reset_colors" );
+	while ( s.next() )
+		handler->reset( KDecorationDefines::SettingColors );
+}
+
+
+static void benchRecolor()
+{
+	static const int sizes[] = { 17, 64, 256 };
+	TQColor color = KDecoration::options()->color( KDecoration::ColorButtonBg, true );
+
+	for ( unsigned int i = 0; i < sizeof( sizes ) / sizeof( sizes[0] ); i++ )
+	{
+		TQImage img( sizes[i], sizes[i], 32 );
+		img.fill( tqRgb( 0x80, 0x90, 0xa0 ) );
+
+		Sampler s( "recolor", TQString( "size=%1x%1" ).arg( sizes[i] ) );
+		while ( s.next() )
+			Recolorer( color ).apply( img );
+	}
+}
+
+
+static void benchGradients()
+{
+	static const int widths[] = { 256, 1024, 4096 };
+	TQColor from = KDecoration::options()->color( KDecoration::ColorTitleBlend, true );
+	TQColor to = KDecoration::options()->color( KDecoration::ColorTitleBar, true );
+	int h = BASE_BUTTON_SIZE + TOP_GRABBAR_WIDTH;
+
+	for ( unsigned int i = 0; i < sizeof( widths ) / sizeof( widths[0] ); i++ )
+	{
+		TQString params = TQString( "width=%1 height=%2" ).arg( widths[i] ).arg( h );
+
+		Sampler miss( "gradient_miss", params );
+		while ( miss.next() )
+		{
+			GradientCache cache;
+			cache.gradient( widths[i], h, from, to, true );
+		}
+
+		GradientCache cache;
+		Sampler hit( "gradient_hit", params );
+		while ( hit.next() )
+			cache.gradient( widths[i], h, from, to, true );
+	}
+
+	Sampler strip( "gradient_strip_miss", TQString( "height=%1" ).arg( h ) );
+	while ( strip.next() )
+	{
+		GradientCache cache;
+		cache.strip( h, from, to, true );
+	}
+}
+
+
+static void benchButtons()
+{
+	KPixmap target;
+	target.resize( BASE_BUTTON_SIZE, BASE_BUTTON_SIZE );
+
+	for ( int glyph = 0; glyph < GlyphCount; glyph++ )
+		for ( int state = 0; state < AtlasStateCount; state++ )
+		{
+			DecorationButton b;
+			b.glyph = glyph;
+			b.state = state;
+
+			Sampler s( "button", TQString( "glyph=%1 state=%2" ).arg( glyph ).arg( state ) );
+			while ( s.next() )
+			{
+				TQPainter p( &target );
+				p.drawPixmap( 0, 0, DecorationRenderer::buttonPixmap( b ) );
+			}
+		}
+}
+
+
+// Full and partial repaints and the shape of a w x h frame
+static void benchFrame( const TQString& params, int w, int h,
+		KDecorationDefines::BorderSize size = KDecorationDefines::BorderNormal )
+{
+	int border, grabBorder;
+	BlueCurveHandler::borderWidths( size, border, grabBorder );
+
+	DecorationRenderer renderer;
+	DecorationState active = windowState( w, h, border, grabBorder, true );
+	DecorationState inactive = windowState( w, h, border, grabBorder, false );
+	KPixmap target;
+	target.resize( w, h );
+
+	TQRegion full( 0, 0, w, h );
+	TQRegion title( DecorationRenderer::titlebarRect( active ) );
+	TQRegion side( DecorationRenderer::leftSideRect( active ) );
+
+	// After the warmup these are blits from the titlebar cache
+	Sampler sFull( "paint_full", params );
+	while ( sFull.next() )
+	{
+		TQPainter p( &target );
+		renderer.paint( &p, active, full );
+	}
+
+	Sampler sInactive( "paint_full_inactive", params );
+	while ( sInactive.next() )
+	{
+		TQPainter p( &target );
+		renderer.paint( &p, inactive, full );
+	}
+
+	Sampler sTitle( "paint_titlebar", params );
+	while ( sTitle.next() )
+	{
+		TQPainter p( &target );
+		renderer.paint( &p, active, title );
+	}
+
+	Sampler sSide( "paint_side", params );
+	while ( sSide.next() )
+	{
+		TQPainter p( &target );
+		renderer.paint( &p, active, side );
+	}
+
+	// The same paints with the titlebars composed every time
+	Sampler sFullUncached( "paint_full_uncached", params );
+	while ( sFullUncached.next() )
+	{
+		renderer.invalidate();
+		TQPainter p( &target );
+		renderer.paint( &p, active, full );
+	}
+
+	Sampler sInactiveUncached( "paint_full_inactive_uncached", params );
+	while ( sInactiveUncached.next() )
+	{
+		renderer.invalidate();
+		TQPainter p( &target );
+		renderer.paint( &p, inactive, full );
+	}
+
+	Sampler sTitleUncached( "paint_titlebar_uncached", params );
+	while ( sTitleUncached.next() )
+	{
+		renderer.invalidate();
+		TQPainter p( &target );
+		renderer.paint( &p, active, title );
+	}
+
+	// Alt-tab back and forth, both titlebars come from the cache
+	bool focus = false;
+	Sampler sFocus( "paint_focus_switch", params );
+	while ( sFocus.next() )
+	{
+		focus = !focus;
+		TQPainter p( &target );
+		renderer.paint( &p, focus ? active : inactive, full );
+	}
+
+	// A new caption on every paint, as with a title showing a counter
+	int n = 0;
+	Sampler sCaption( "paint_caption_change", params );
+	while ( sCaption.next() )
+	{
+		active.caption = TQString( "bluecurve-bench %1" ).arg( n++ );
+		TQPainter p( &target );
+		renderer.paint( &p, active, title );
+	}
+
+	Sampler sShape( "shape", params );
+	while ( sShape.next() )
+		DecorationRenderer::shape( w, h );
+
+	// What doShape() costs, including sending the mask to the server
+	TQWidget widget;
+	widget.resize( w, h );
+	Sampler sMask( "shape_setmask", params );
+	while ( sMask.next() )
+		widget.setMask( DecorationRenderer::shape( w, h ) );
+}
+
+
+static void benchWidths()
+{
+	static const int widths[] = { 64, 128, 256, 512, 1024, 2048, 4096 };
+	int h = 480;
+
+	for ( unsigned int i = 0; i < sizeof( widths ) / sizeof( widths[0] ); i++ )
+		benchFrame( TQString( "width=%1 height=%2" ).arg( widths[i] ).arg( h ),
+			widths[i], h );
+}
+
+
+// The border size decides how large the frame around a client gets
+static void benchBorderSizes()
+{
+	static const struct {
+		KDecorationDefines::BorderSize size;
+		const char* name;
+	} sizes[] = {
+		{ KDecorationDefines::BorderTiny, "Tiny" },
+		{ KDecorationDefines::BorderNormal, "Normal" },
+		{ KDecorationDefines::BorderLarge, "Large" },
+		{ KDecorationDefines::BorderVeryLarge, "VeryLarge" },
+		{ KDecorationDefines::BorderHuge, "Huge" },
+		{ KDecorationDefines::BorderVeryHuge, "VeryHuge" },
+		{ KDecorationDefines::BorderOversized, "Oversized" },
+	};
+	int clientWidth = 640;
+	int clientHeight = 480;
+
+	for ( unsigned int i = 0; i < sizeof( sizes ) / sizeof( sizes[0] ); i++ )
+	{
+		int border, grabBorder;
+		BlueCurveHandler::borderWidths( sizes[i].size, border, grabBorder );
+
+		int w = clientWidth + 2*border;
+		int h = clientHeight + BASE_BUTTON_SIZE + 4 + grabBorder;
+		benchFrame( TQString( "border=%1 width=%2 height=%3" )
+			.arg( sizes[i].name ).arg( w ).arg( h ), w, h, sizes[i].size );
+	}
+}
+
+
+static TDECmdLineOptions options[] =
+{
+	{ "iterations <count>", I18N_NOOP("Timed iterations per benchmark"), "200" },
+	{ "warmup <count>", I18N_NOOP("Untimed iterations before each benchmark"), "10" },
+	{ "csv", I18N_NOOP("Write CSV instead of JSON"), 0 },
+	{ "o", 0, 0 },
+	{ "output <file>", I18N_NOOP("Write the results to a file instead of stdout"), 0 },
+	TDECmdLineLastOption
+};
+
+int main( int argc, char** argv )
+{
+	TDECmdLineArgs::init( argc, argv, "bluecurve-bench",
+		I18N_NOOP("Bluecurve benchmarks"),
+		I18N_NOOP("Measures the Bluecurve decoration's paint paths"), "1.0" );
+	TDECmdLineArgs::addCmdLineOptions( options );
+	TDEApplication app( false, true );
+	TDECmdLineArgs* args = TDECmdLineArgs::parsedArgs();
+
+	iterations = TQMAX( args->getOption( "iterations" ).toInt(), 1 );
+	warmup = TQMAX( args->getOption( "warmup" ).toInt(), 0 );
+
+	BenchOptions decorationOptions;
+
+	benchHandlerCreate();
+	BlueCurveHandler* handler = new BlueCurveHandler();
+	benchHandlerReset( handler );
+
+	benchRecolor();
+	benchGradients();
+	benchButtons();
+	benchWidths();
+	benchBorderSizes();
+
+	// How often the frame paints found their gradients cached
+	BenchCounters counters;
+	BenchCounter hits = { "gradient_cache_hits", gradientCache->hits() };
+	BenchCounter misses = { "gradient_cache_misses", gradientCache->misses() };
+	counters.append( hits );
+	counters.append( misses );
+
+	delete handler;
+
+	TQFile file;
+	if ( args->isSet( "output" ) )
+	{
+		file.setName( args->getOption( "output" ) );
+		if ( !file.open( IO_WriteOnly ) )
+		{
+			tqWarning( "bluecurve-bench: cannot write %s", file.name().latin1() );
+			return 1;
+		}
+	} else
+		file.open( IO_WriteOnly, stdout );
+
+	TQTextStream out( &file );
+	if ( args->isSet( "csv" ) )
+		writeCsv( out, results, counters );
+	else
+		writeJson( out, "bluecurve", TQString( "  \"iterations\": %1,\n  \"warmup\": %2,\n" )
+			.arg( iterations ).arg( warmup ), results, counters );
+
+	return 0;
+}
+
+// vim: ts=4
@@ -0,0 +1,379 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Replays a decoration event trace offscreen and reports how long the
+ *	decorations took to handle each kind of event.
+ *
+ *	Record a trace by setting TraceFile in the BlueCurve group of
+ *	twinrc and reconfiguring twin, remove the key to stop. Then:
+ *
+ *		xvfb-run ./bluecurve-replay --loops 10 bluecurve.trace > replay.json
+ *
+ *	Every decoration in the trace gets a renderer and an offscreen
+ *	pixmap. A shape is computed for each resize, and what the decoration
+ *	painted is painted again. The paints following an event of the same
+ *	decoration are counted towards it, only paints without a preceding
+ *	event, like exposures, are reported as "expose".
+ */
+
+#include <tdeapplication.h>
+#include <tdecmdlineargs.h>
+#include <tdelocale.h>
+#include <tqdatastream.h>
+#include <tqfile.h>
+#include <tqintdict.h>
+#include <tqpainter.h>
+#include <tqtextstream.h>
+#include <tqvaluevector.h>
+
+#include <time.h>
+
+#include "bluecurveclient.h"
+#include "bluecurverenderer.h"
+#include "bluecurvetrace.h"
+#include "benchutil.h"
+
+using namespace BlueCurve;
+
+static const char* eventNames[TraceEventCount] = { 0, "geometry", "resize",
+	"caption", "active", "maximize", "desktop", "hover", "press", "release",
+	"expose", "button_paint", "destroy" };
+
+// A decoration as far as the trace tells
+struct ReplayWindow
+{
+	DecorationState state;
+	DecorationRenderer renderer;
+	KPixmap target;
+};
+
+static TQIntDict<ReplayWindow> windows;
+static TQValueVector<double> samples[TraceEventCount];
+
+
+// Applies a hover, press or release. Only one button is hovered at a time.
+static void setButtonState( DecorationState& s, int button, int bit, bool on )
+{
+	int n = 0;
+	TQValueList<DecorationButton>::Iterator it;
+	for ( it = s.buttons.begin(); it != s.buttons.end(); ++it, n++ )
+	{
+		if ( n == button && on )
+			(*it).state |= bit;
+		else if ( n == button || bit == AtlasHover )
+			(*it).state &= ~bit;
+	}
+}
+
+
+static DecorationButton* traceButton( DecorationState& s, int button )
+{
+	if ( button < 0 || button >= (int) s.buttons.count() )
+		return NULL;
+	return &s.buttons[button];
+}
+
+
+static void readGeometry( TQDataStream& in, ReplayWindow* w )
+{
+	DecorationState& s = w->state;
+	TQ_UINT8 active, tool, count;
+	TQ_INT16 titleHeight;
+	in >> s.size >> s.caption >> active >> tool >> titleHeight >> s.titleRect >> count;
+	s.active = active;
+	s.tool = tool;
+	s.titleHeight = titleHeight;
+	s.font = DecorationRenderer::titleFont( s.tool );
+	s.readOptions();
+
+	// Traces don't record the border size, assume the default one
+	int border, grabBorder;
+	BlueCurveHandler::borderWidths( KDecorationDefines::BorderNormal, border, grabBorder );
+	int top = s.titleHeight + 4;
+	int bottom = s.tool ? border : grabBorder;
+	s.client = TQRect( border, top, s.size.width() - 2*border,
+		s.size.height() - top - bottom );
+
+	s.buttons.clear();
+	for ( int i = 0; i < count; i++ )
+	{
+		TQ_INT8 glyph;
+		TQ_UINT8 pos, state, on, hidden, paint;
+		DecorationButton b;
+		in >> glyph >> pos >> state >> on >> hidden >> paint >> b.rect;
+		b.glyph = glyph;
+		b.pos = pos;
+		b.state = state;
+		b.on = on;
+		b.hidden = hidden;
+		b.paint = paint;
+		s.buttons.append( b );
+	}
+
+	if ( w->target.size() != s.size )
+		w->target.resize( s.size );
+}
+
+
+/*
+ * Reads and replays one record. Returns the decoration and event type,
+ * or false at the end of the trace.
+ */
+static bool replayRecord( TQDataStream& in, unsigned int& id, int& type )
+{
+	TQ_UINT8 t;
+	TQ_UINT32 wid, time;
+	in >> t >> wid >> time;
+
+	id = wid;
+	type = t;
+	if ( type <= 0 || type >= TraceEventCount )
+	{
+		tqWarning( "bluecurve-replay: unknown event %d", type );
+		return false;
+	}
+
+	ReplayWindow* w = windows.find( id );
+	if ( !w && type == TraceGeometry )
+	{
+		w = new ReplayWindow;
+		windows.insert( id, w );
+	}
+
+	// Windows whose geometry we never saw are read past
+	static ReplayWindow dummy;
+	if ( !w )
+		w = &dummy;
+	DecorationState& s = w->state;
+
+	switch ( type )
+	{
+		case TraceGeometry:
+			readGeometry( in, w );
+			break;
+
+		case TraceResize:
+			in >> s.size;
+			if ( w->target.size() != s.size )
+				w->target.resize( s.size );
+			DecorationRenderer::shape( s.size.width(), s.size.height() );
+			break;
+
+		case TraceCaption:
+			in >> s.caption;
+			break;
+
+		case TraceActive:
+		{
+			TQ_UINT8 active;
+			in >> active;
+			s.active = active;
+			s.readOptions();
+			TQValueList<DecorationButton>::Iterator it;
+			for ( it = s.buttons.begin(); it != s.buttons.end(); ++it )
+				if ( s.active )
+					(*it).state |= AtlasActive;
+				else
+					(*it).state &= ~AtlasActive;
+			break;
+		}
+
+		case TraceMaximize:
+		{
+			TQ_UINT8 mode;
+			in >> mode;
+			TQValueList<DecorationButton>::Iterator it;
+			for ( it = s.buttons.begin(); it != s.buttons.end(); ++it )
+				if ( (*it).glyph == GlyphMaximize || (*it).glyph == GlyphRestore )
+					(*it).glyph = (mode == KDecorationDefines::MaximizeFull)
+						? GlyphRestore : GlyphMaximize;
+			break;
+		}
+
+		case TraceDesktop:
+		{
+			TQ_UINT8 onAll;
+			in >> onAll;
+			TQValueList<DecorationButton>::Iterator it;
+			for ( it = s.buttons.begin(); it != s.buttons.end(); ++it )
+				if ( (*it).glyph == GlyphPinUp || (*it).glyph == GlyphPinDown )
+					(*it).on = onAll;
+			break;
+		}
+
+		case TraceHover:
+		{
+			TQ_INT8 button;
+			in >> button;
+			setButtonState( s, button, AtlasHover, true );
+			break;
+		}
+
+		case TracePress:
+		case TraceRelease:
+		{
+			TQ_INT8 button;
+			TQ_UINT8 mouseButton;
+			in >> button >> mouseButton;
+			setButtonState( s, button, AtlasDown, type == TracePress );
+			break;
+		}
+
+		case TraceExpose:
+		{
+			TQRegion region;
+			in >> region;
+			if ( w != &dummy )
+			{
+				TQPainter p( &w->target );
+				w->renderer.paint( &p, s, region );
+			}
+			break;
+		}
+
+		case TraceButtonPaint:
+		{
+			TQ_INT8 button;
+			in >> button;
+			DecorationButton* b = traceButton( s, button );
+			if ( b && w != &dummy )
+			{
+				TQPainter p( &w->target );
+				p.drawPixmap( b->rect.topLeft(), DecorationRenderer::buttonPixmap( *b ) );
+			}
+			break;
+		}
+
+		case TraceDestroy:
+			windows.remove( id );
+			break;
+	}
+
+	return true;
+}
+
+
+// Replays the whole trace once, timing every event with the paints
+// that follow it
+static bool replay( const TQString& fileName )
+{
+	TQFile file( fileName );
+	if ( !file.open( IO_ReadOnly ) )
+	{
+		tqWarning( "bluecurve-replay: cannot read %s", fileName.latin1() );
+		return false;
+	}
+
+	TQDataStream in( &file );
+	TQ_UINT32 magic, version;
+	in >> magic >> version;
+	if ( magic != TRACE_MAGIC || version != TRACE_VERSION )
+	{
+		tqWarning( "bluecurve-replay: %s is not a version %d trace",
+			fileName.latin1(), TRACE_VERSION );
+		return false;
+	}
+
+	// The event being timed, and the decoration it happened to
+	int pending = 0;
+	unsigned int pendingId = 0;
+	double pendingTime = 0;
+
+	while ( !in.atEnd() )
+	{
+		timespec start;
+		clock_gettime( CLOCK_MONOTONIC, &start );
+
+		unsigned int id;
+		int type;
+		if ( !replayRecord( in, id, type ) )
+			break;
+		tqApp->syncX();
+		double t = elapsedUs( start );
+
+		bool paint = (type == TraceExpose || type == TraceButtonPaint);
+		if ( paint && pending && id == pendingId )
+		{
+			pendingTime += t;
+			continue;
+		}
+
+		if ( pending )
+			samples[pending].push_back( pendingTime );
+		pending = paint ? TraceExpose : type;
+		pendingId = id;
+		pendingTime = t;
+	}
+
+	if ( pending )
+		samples[pending].push_back( pendingTime );
+
+	windows.clear();
+	return true;
+}
+
+
+static TDECmdLineOptions options[] =
+{
+	{ "loops <count>", I18N_NOOP("Number of times to replay the trace"), "1" },
+	{ "csv", I18N_NOOP("Write CSV instead of JSON"), 0 },
+	{ "o", 0, 0 },
+	{ "output <file>", I18N_NOOP("Write the results to a file instead of stdout"), 0 },
+	{ "+trace", I18N_NOOP("Trace file recorded by the decoration"), 0 },
+	TDECmdLineLastOption
+};
+
+int main( int argc, char** argv )
+{
+	TDECmdLineArgs::init( argc, argv, "bluecurve-replay",
+		I18N_NOOP("Bluecurve trace replay"),
+		I18N_NOOP("Replays recorded Bluecurve decoration events offscreen"), "1.0" );
+	TDECmdLineArgs::addCmdLineOptions( options );
+	TDEApplication app( false, true );
+	TDECmdLineArgs* args = TDECmdLineArgs::parsedArgs();
+
+	if ( args->count() != 1 )
+		TDECmdLineArgs::usage( i18n("No trace file given") );
+
+	int loops = TQMAX( args->getOption( "loops" ).toInt(), 1 );
+	TQString trace = TQFile::decodeName( args->arg( 0 ) );
+
+	BenchOptions decorationOptions;
+	BlueCurveHandler* handler = new BlueCurveHandler();
+	windows.setAutoDelete( true );
+
+	for ( int i = 0; i < loops; i++ )
+		if ( !replay( trace ) )
+			return 1;
+
+	delete handler;
+
+	BenchResults results;
+	for ( int type = 1; type < TraceEventCount; type++ )
+		if ( !samples[type].isEmpty() )
+			results.append( summarize( eventNames[type],
+				TQString( "loops=%1" ).arg( loops ), samples[type] ) );
+
+	TQFile file;
+	if ( args->isSet( "output" ) )
+	{
+		file.setName( args->getOption( "output" ) );
+		if ( !file.open( IO_WriteOnly ) )
+		{
+			tqWarning( "bluecurve-replay: cannot write %s", file.name().latin1() );
+			return 1;
+		}
+	} else
+		file.open( IO_WriteOnly, stdout );
+
+	TQTextStream out( &file );
+	if ( args->isSet( "csv" ) )
+		writeCsv( out, results );
+	else
+		writeJson( out, "bluecurve-replay", TQString( "  \"trace\": \"%1\",\n" )
+			.arg( trace ), results );
+
+	return 0;
+}
+
+// vim: ts=4
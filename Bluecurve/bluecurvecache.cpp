@@ -0,0 +1,92 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Shared pixmap caches used by the decoration.
+ */
+
+#include "bluecurvecache.h"
+
+#include <kpixmapeffect.h>
+
+// Gradients are allocated in steps of this width, so that a window
+// growing a few pixels at a time doesn't regenerate on every step.
+#define GRADIENT_WIDTH_STEP 256
+
+namespace BlueCurve
+{
+
+GradientCache::GradientCache( int maxEntries )
+	: m_cache( maxEntries ), m_hits( 0 ), m_misses( 0 )
+{
+	m_cache.setAutoDelete( true );
+}
+
+
+GradientCache::~GradientCache()
+{
+	m_cache.clear();
+}
+
+
+const KPixmap* GradientCache::gradient( int width, int height,
+		const TQColor& from, const TQColor& to, bool active )
+{
+	TQString key = TQString( "g:%1:%2:%3:%4" ).arg( height ).arg( active ? 1 : 0 )
+		.arg( from.rgb() ).arg( to.rgb() );
+
+	int allocWidth = ( (width + GRADIENT_WIDTH_STEP - 1) / GRADIENT_WIDTH_STEP )
+		* GRADIENT_WIDTH_STEP;
+	return lookup( key, allocWidth, height, from, to );
+}
+
+
+const KPixmap* GradientCache::strip( int height,
+		const TQColor& from, const TQColor& to, bool active )
+{
+	TQString key = TQString( "s:%1:%2:%3:%4" ).arg( height ).arg( active ? 1 : 0 )
+		.arg( from.rgb() ).arg( to.rgb() );
+
+	return lookup( key, GRADIENT_STRIP_WIDTH, height, from, to );
+}
+
+
+const KPixmap* GradientCache::lookup( const TQString& key, int width, int height,
+		const TQColor& from, const TQColor& to )
+{
+	KPixmap* pix = m_cache.find( key );
+	if ( pix && pix->width() >= width )
+	{
+		m_hits++;
+		return pix;
+	}
+
+	m_misses++;
+
+	// Too narrow for this titlebar, drop it and build a wider one
+	if ( pix )
+		m_cache.remove( key );
+
+	pix = new KPixmap();
+	pix->resize( width, height );
+	KPixmapEffect::gradient( *pix, from, to, KPixmapEffect::VerticalGradient );
+
+	if ( !m_cache.insert( key, pix ) )
+	{
+		delete pix;
+		return NULL;
+	}
+
+	return pix;
+}
+
+
+void GradientCache::clear()
+{
+	m_cache.clear();
+	m_hits = 0;
+	m_misses = 0;
+}
+
+}
+
+// vim: ts=4
@@ -0,0 +1,58 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Shared pixmap caches used by the decoration.
+ */
+
+#ifndef _BLUECURVE_CACHE_H
+#define _BLUECURVE_CACHE_H
+
+#include <tqcache.h>
+#include <tqcolor.h>
+#include <kpixmap.h>
+
+// Width of the gradient columns handed out by GradientCache::strip()
+#define GRADIENT_STRIP_WIDTH 8
+
+namespace BlueCurve {
+
+/*
+ * Bounded LRU cache of vertical titlebar gradients.
+ *
+ * Entries are keyed by (height, active, color pair), so windows of
+ * different widths share one gradient instead of evicting each other.
+ * A cached gradient is at least as wide as the widest request seen so
+ * far; narrower titlebars simply blit the left part of it.
+ *
+ * Since the gradients only vary vertically, strip() returns a narrow
+ * column of GRADIENT_STRIP_WIDTH pixels which callers tile across the
+ * target instead. Its cost and memory don't depend on the width at all.
+ */
+class GradientCache
+{
+	public:
+		GradientCache( int maxEntries = 16 );
+		~GradientCache();
+
+		const KPixmap* gradient( int width, int height,
+			const TQColor& from, const TQColor& to, bool active );
+		const KPixmap* strip( int height,
+			const TQColor& from, const TQColor& to, bool active );
+		void clear();
+
+		unsigned long hits() const { return m_hits; }
+		unsigned long misses() const { return m_misses; }
+
+	private:
+		const KPixmap* lookup( const TQString& key, int width, int height,
+			const TQColor& from, const TQColor& to );
+
+		TQCache<KPixmap> m_cache;
+		unsigned long m_hits;
+		unsigned long m_misses;
+};
+
+}
+
+#endif
+// vim: ts=4
@@ -15,40 +15,44 @@
  */
 
 #include "bluecurveclient.h"
-
+#include "bluecurvecache.h"
+#include "bluecurvecorners.h"
+#include "bluecurverecolor.h"
+#include "bluecurverenderer.h"
+#include "bluecurveprobes.h"
+#include "bluecurveshadow.h"
+#include "bluecurvestats.h"
+#include "bluecurvetrace.h"
+
+#include <dcopclient.h>
+#include <tdeapplication.h>
 #include <tdeconfig.h>
 #include <tdeglobal.h>
 #include <kpixmapeffect.h>
 #include <kimageeffect.h>
 #include <kdrawutil.h>
 #include <tdelocale.h>
-#include <tqlayout.h>
-#include <tqdrawutil.h>
 #include <tqbitmap.h>
 #include <tqimage.h>
 #include <tqtooltip.h>
 #include <tqapplication.h>
 #include <tqlabel.h>
 #include <kdebug.h>
+#include <kmanagerselection.h>
 
 
-#define BASE_BUTTON_SIZE  17
-#define BORDER_WIDTH      6
-#define CORNER_RADIUS     12
-
-#define BUTTON_DIAM       12
-#define TOP_GRABBAR_WIDTH 2
-#define BOTTOM_CORNER     5
+// Width of the pre-composited stipple tile, a multiple of the 4 px pattern
+#define STIPPLE_TILE_WIDTH 32
 
 
 namespace BlueCurve
 {
 #include "bitmaps.h"
 
-KPixmap* titlePix;
+KPixmap* stippleTile;
+KPixmap* toolStippleTile;
 KPixmap* titleBuffer;
-KPixmap* aUpperGradient;
-KPixmap* iUpperGradient;
+GradientCache* gradientCache;
 
 KPixmap* pinDownPix;
 KPixmap* pinUpPix;
@@ -60,28 +64,69 @@ KPixmap* btnDownPix;
 KPixmap* ibtnUpPix;
 KPixmap* ibtnDownPix;
 
+// Pre-rendered buttons, one pixmap per glyph and ButtonAtlasState
+KPixmap* buttonAtlas[GlyphCount][AtlasStateCount];
+
 TQPixmap* bottomLeftPix;
 TQPixmap* bottomRightPix;
 TQPixmap* abottomLeftPix;
 TQPixmap* abottomRightPix;
 
+// Rounded button masks for ButtonLeft and ButtonRight
+TQRegion* buttonShapes;
+
+// Window shape corner cutouts, see createShapeCorners()
+TQRegion* shapeCorners;
+TQSize shapeCornersMinSize;
+
+// Alpha masks for the same corners, see CornerAlpha
+CornerAlpha* cornerAlpha;
+
+// Shadow tiles, indexed by active, NULL without shadows
+ShadowTiles* shadowTiles[2];
+
 BlueCurveHandler* clientHandler;
 
 bool BlueCurve_initialized = false;
 bool useGradients;
+bool useGradientStrips;
 bool showGrabBar;
 bool showTitleBarStipple;
 bool largeToolButtons;
+bool windowlessButtons;
+bool serverSideBackground;
+bool translucentCorners;
+static bool compositing;
+static bool showShadows;
+static int shadowSize;
+static int shadowOpacity;
 
 static int grabBorderWidth;
 static int borderWidth;
 static int toolTitleHeight;
 static int normalTitleHeight;
+static int captionUpdateInterval;
+
+// Bytes the renderers may spend on cached titlebars
+unsigned long titleCacheBudget;
+
+// Set while decoration events are being recorded
+TraceRecorder* traceRecorder;
+static unsigned int nextTraceId;
 
 BlueCurveHandler::BlueCurveHandler()
 {
+	// Composition managers come and go, twin starts its own after
+	// loading the decoration
+	m_compositingWatcher = new TDESelectionWatcher(
+		TQString( "_NET_WM_CM_S%1" ).arg( tqt_xscreen() ).latin1(), -1, this );
+	connect( m_compositingWatcher, TQ_SIGNAL(newOwner(Window)),
+		this, TQ_SLOT(compositingChanged()) );
+	connect( m_compositingWatcher, TQ_SIGNAL(lostOwner()),
+		this, TQ_SLOT(compositingChanged()) );
+
 	readConfig();
-	createPixmaps();
+	createPixmaps( AssetAll );
 	BlueCurve_initialized = true;
 }
 
@@ -89,7 +134,31 @@ BlueCurveHandler::BlueCurveHandler()
 BlueCurveHandler::~BlueCurveHandler()
 {
 	BlueCurve_initialized = false;
-	freePixmaps();
+	freePixmaps( AssetAll );
+
+	delete traceRecorder;
+	traceRecorder = NULL;
+	DecorationStats::setEnabled( false );
+}
+
+
+// Switches the decorations between transparent corners and shapes.
+// With shadows the frame extents change too, and twin only asks for
+// them again when it reconfigures, so it has to do the switch.
+void BlueCurveHandler::compositingChanged()
+{
+	bool active = translucentCorners && m_compositingWatcher->owner() != None;
+	if (active == compositing)
+		return;
+
+	if (showShadows)
+	{
+		kapp->dcopClient()->send( "twin*", "", "reconfigure()", TQString("") );
+		return;
+	}
+
+	compositing = active;
+	resetDecorations( SettingBlueCurveCorners );
 }
 
 
@@ -99,38 +168,133 @@ KDecoration* BlueCurveHandler::createDecoration( KDecorationBridge* bridge )
 }
 
 
+// Returns the cached assets which have to be rebuilt for the given
+// Setting* change bits, including our own SettingBlueCurve* bits.
+unsigned long BlueCurveHandler::affectedAssets( unsigned long changed )
+{
+	static const struct {
+		unsigned long asset;
+		unsigned long dependsOn;
+	} deps[] = {
+		{ AssetStipple,   SettingColors | SettingBlueCurveTitleSize | SettingBlueCurveStipple
+			| SettingBlueCurveGradients },
+		{ AssetGradients, SettingColors | SettingBlueCurveGradients },
+		{ AssetPins,      SettingColors },
+		{ AssetButtons,   SettingColors | SettingBlueCurveGradients },
+		{ AssetCorners,   SettingColors },
+		{ AssetShadows,   SettingBlueCurveShadow },
+	};
+
+	unsigned long assets = 0;
+	for ( unsigned int i = 0; i < sizeof( deps ) / sizeof( deps[0] ); i++ )
+		if ( changed & deps[i].dependsOn )
+			assets |= deps[i].asset;
+
+	// The button atlas is composed from the button and pin pixmaps
+	if ( assets & AssetPins )
+		assets |= AssetButtons;
+
+	return assets;
+}
+
+
 bool BlueCurveHandler::reset(unsigned long changed)
 {
+	// A different decoration plugin, nothing we can do in place
+	if (changed & SettingDecoration)
+		return true;
+
+	StatTimer timer( StatReset );
+	BLUECURVE_PROBE1( reset_entry, changed );
 	BlueCurve_initialized = false;
-	freePixmaps();
-	readConfig();
-	createPixmaps();
-	BlueCurve_initialized = true;
-	bool needHardReset = true;
-	if (changed & SettingColors)
-		needHardReset = false;
+	changed |= readConfig();
 
-	if (needHardReset) {
-		return true;
-	} else {
-		resetDecorations(changed);
-		return false;
-	}
+	unsigned long assets = affectedAssets(changed);
+	freePixmaps(assets);
+	createPixmaps(assets);
+	BlueCurve_initialized = true;
 
-	return true;
+	// Existing decorations relayout and repaint themselves in place
+	resetDecorations(changed);
+	BLUECURVE_PROBE1( reset_return, changed );
+	return false;
 }
 
 
-void BlueCurveHandler::readConfig()
+// Reads the configuration and returns the SettingBlueCurve* bits of the
+// settings that changed since the last call.
+unsigned long BlueCurveHandler::readConfig()
 {
 	TDEConfig* conf = TDEGlobal::config();
 	conf->setGroup("BlueCurve");
 
+	bool oldShowGrabBar = showGrabBar;
+	bool oldShowTitleBarStipple = showTitleBarStipple;
+	bool oldUseGradients = useGradients;
+	bool oldUseGradientStrips = useGradientStrips;
+	bool oldWindowlessButtons = windowlessButtons;
+	bool oldServerSideBackground = serverSideBackground;
+	bool oldTranslucentCorners = translucentCorners;
+	bool oldCompositing = compositing;
+	bool oldShowShadows = showShadows;
+	int oldShadowSize = shadowSize;
+	int oldShadowOpacity = shadowOpacity;
+	int oldNormalTitleHeight = normalTitleHeight;
+
 	showGrabBar = conf->readBoolEntry("ShowGrabBar", true);
 	showTitleBarStipple = conf->readBoolEntry("ShowTitleBarStipple", true);
 	useGradients = conf->readBoolEntry("UseGradients", true);
+	useGradientStrips = conf->readBoolEntry("UseGradientStrips", true);
 	int size = conf->readNumEntry("TitleBarSize", 0);
 
+	// Paint and hit-test the buttons in the decoration widget itself
+	// instead of giving every button its own X window
+	windowlessButtons = conf->readBoolEntry("WindowlessButtons", false);
+
+	// Let the X server repaint exposed frames from background pixmaps
+	serverSideBackground = conf->readBoolEntry("ServerSideBackground", false);
+
+	// Under a composition manager, antialias the corners of frames with
+	// an alpha channel instead of giving them a window shape
+	translucentCorners = conf->readBoolEntry("TranslucentCorners", true);
+	compositing = translucentCorners && m_compositingWatcher->owner() != None;
+
+	// Drop shadows around frames with transparent corners, ShadowSize
+	// wide in pixels and ShadowOpacity percent opaque when active
+	showShadows = conf->readBoolEntry("Shadows", false);
+	shadowSize = conf->readNumEntry("ShadowSize", 12);
+	if (shadowSize < 2) shadowSize = 2;
+	if (shadowSize > 32) shadowSize = 32;
+	shadowOpacity = conf->readNumEntry("ShadowOpacity", 50);
+	if (shadowOpacity < 0) shadowOpacity = 0;
+	if (shadowOpacity > 100) shadowOpacity = 100;
+
+	// Minimum time in ms between two caption repaints, 0 disables coalescing
+	captionUpdateInterval = conf->readNumEntry("CaptionUpdateInterval", 16);
+	if (captionUpdateInterval < 0) captionUpdateInterval = 0;
+
+	// Room in KB for keeping the active and inactive titlebar of each
+	// window, so focus changes only blit. 0 renders on every paint.
+	int titleCacheSize = conf->readNumEntry("TitleCacheSize", 8192);
+	titleCacheBudget = (unsigned long) TQMAX(titleCacheSize, 0) * 1024;
+
+	// Operation timings, dumped on SIGUSR2, see bluecurvestats.h
+	DecorationStats::setEnabled(conf->readBoolEntry("CollectStats", false));
+
+	// Record the events of all decorations for bluecurve-replay
+	TQString traceFile = conf->readPathEntry("TraceFile");
+	if (traceFile != (traceRecorder ? traceRecorder->fileName() : TQString::null))
+	{
+		delete traceRecorder;
+		traceRecorder = NULL;
+		if (!traceFile.isEmpty())
+		{
+			traceRecorder = new TraceRecorder(traceFile);
+			if (!traceRecorder->isOpen())
+				kdWarning(1212) << "BlueCurve: cannot write trace " << traceFile << endl;
+		}
+	}
+
 	if (size < 0) size = 0;
 	if (size > 2) size = 2;
 
@@ -138,82 +302,181 @@ void BlueCurveHandler::readConfig()
 	toolTitleHeight = normalTitleHeight - 4;
 	largeToolButtons = (toolTitleHeight >= 16) ? true : false;
 
-	int new_borderWidth;
-	switch(options()->preferredBorderSize(this)) {
+	borderWidths(options()->preferredBorderSize(this), borderWidth, grabBorderWidth);
+
+	unsigned long changed = 0;
+	if (showGrabBar != oldShowGrabBar)
+		changed |= SettingBlueCurveGrabBar;
+	if (showTitleBarStipple != oldShowTitleBarStipple)
+		changed |= SettingBlueCurveStipple;
+	if (useGradients != oldUseGradients || useGradientStrips != oldUseGradientStrips)
+		changed |= SettingBlueCurveGradients;
+	if (normalTitleHeight != oldNormalTitleHeight)
+		changed |= SettingBlueCurveTitleSize;
+	if (windowlessButtons != oldWindowlessButtons)
+		changed |= SettingBlueCurveButtonMode;
+	if (serverSideBackground != oldServerSideBackground)
+		changed |= SettingBlueCurveBackground;
+	if (translucentCorners != oldTranslucentCorners || compositing != oldCompositing)
+		changed |= SettingBlueCurveCorners;
+	if (showShadows != oldShowShadows || shadowSize != oldShadowSize
+		|| shadowOpacity != oldShadowOpacity)
+		changed |= SettingBlueCurveShadow;
+	return changed;
+}
+
+
+// The frame width for a border size, and the height of the bottom
+// grab bar that goes with it.
+void BlueCurveHandler::borderWidths( BorderSize size, int& border, int& grabBorder )
+{
+	switch(size) {
 	case BorderLarge:
-		new_borderWidth = 8;
+		border = 8;
 		break;
 	case BorderVeryLarge:
-		new_borderWidth = 12;
+		border = 12;
 		break;
 	case BorderHuge:
-		new_borderWidth = 18;
+		border = 18;
 		break;
 	case BorderVeryHuge:
-		new_borderWidth = 27;
+		border = 27;
 		break;
 	case BorderOversized:
-		new_borderWidth = 40;
+		border = 40;
 		break;
 	case BorderTiny:
 	case BorderNormal:
 	default:
-		new_borderWidth = 4;
+		border = 4;
+	}
+
+	grabBorder = (border > 15) ? border + 15 : 2*border;
+}
+
+
+// This paints the button pixmaps upon loading the style, and rebuilds
+// the given Asset* groups on a reset.
+void BlueCurveHandler::createPixmaps( unsigned long assets )
+{
+	StatTimer timer( StatCreatePixmaps );
+	BLUECURVE_PROBE1( pixmaps_entry, assets );
+
+	// Titlebar gradients are created on demand
+	if (assets & AssetGradients)
+		gradientCache = new GradientCache();
+
+	// The stipple is composited over the titlebar gradient
+	if (assets & AssetStipple)
+		createStipple();
+
+	if (assets & AssetPins)
+		createPins();
+
+	// Create a title buffer for flicker-free painting
+	if (!titleBuffer)
+		titleBuffer = new KPixmap();
+
+	if (assets & AssetButtons)
+	{
+		createButtonBackgrounds();
+		createButtonAtlas();
+	}
+
+	if (assets & AssetCorners)
+	{
+		createCorners();
+		createShapeCorners();
+		cornerAlpha = new CornerAlpha();
 	}
 
-	borderWidth = new_borderWidth;
-	grabBorderWidth = (borderWidth > 15) ? borderWidth + 15 : 2*borderWidth;
+	if (assets & AssetShadows)
+		createShadows();
+
+	// These only depend on constants
+	if (!buttonShapes)
+		createButtonShapes();
+
+	BLUECURVE_PROBE1( pixmaps_return, assets );
 }
 
 
-// This paints the button pixmaps upon loading the style.
-void BlueCurveHandler::createPixmaps()
+void BlueCurveHandler::createStipple()
 {
 	// Make the titlebar stipple optional
 	if (showTitleBarStipple)
 	{
-		TQPainter p;
-		TQPainter maskPainter;
-		int x, y;
-		titlePix = new KPixmap();
-		titlePix->resize(132, normalTitleHeight+2);
-		TQBitmap mask(132, normalTitleHeight+2);
-
-		mask.fill(TQt::color0);
-
-		p.begin(titlePix);
-		maskPainter.begin(&mask);
-		maskPainter.setPen(TQt::color1);
-
-		TQColor lighterColor(options()->color(ColorTitleBar, true).light (150));
-		int h, s, v;
-		lighterColor.hsv (&h, &s, &v);
-		s /= 2;
-		s = (s > 255) ? 255 : (int) s;
-		TQColor satColor(h, s, v, TQColor::Hsv);
-
-		KPixmapEffect::gradient(*titlePix,
-				satColor,
-				satColor.dark(150),
-				KPixmapEffect::VerticalGradient);
-
-		for(y = 0; y < (normalTitleHeight+2); y++) {
-			for(x = (3 - y) % 4; x < 132; x += 4) {
-				maskPainter.drawPoint(x, y);
-			}
-		}
-
-		maskPainter.end();
-		p.end();
-		titlePix->setMask(mask);
+		stippleTile = createStippleTile(normalTitleHeight);
+		toolStippleTile = createStippleTile(toolTitleHeight);
 	} else
-		titlePix = NULL;
+	{
+		stippleTile = NULL;
+		toolStippleTile = NULL;
+	}
+}
+
+
+// Renders the stipple over the active titlebar background into an
+// unmasked tile, so drawing it is a plain tiled copy.
+KPixmap* BlueCurveHandler::createStippleTile(int titleHeight)
+{
+	int tileHeight = titleHeight + 1;
+	int stippleHeight = normalTitleHeight + 2;
+
+	// Every fourth pixel, shifted left by one on each row
+	int bytesPerLine = STIPPLE_TILE_WIDTH / 8;
+	TQMemArray<uchar> bits(bytesPerLine * stippleHeight);
+	for (int y = 0; y < stippleHeight; y++)
+	{
+		int phase = (3 - y % 4);
+		for (int i = 0; i < bytesPerLine; i++)
+			bits[y * bytesPerLine + i] = 0x11 << phase;
+	}
+	TQBitmap mask(STIPPLE_TILE_WIDTH, stippleHeight, bits.data(), true);
+
+	TQColor lighterColor(options()->color(ColorTitleBar, true).light (150));
+	int h, s, v;
+	lighterColor.hsv (&h, &s, &v);
+	s /= 2;
+	s = (s > 255) ? 255 : (int) s;
+	TQColor satColor(h, s, v, TQColor::Hsv);
+
+	KPixmap stipple;
+	stipple.resize(STIPPLE_TILE_WIDTH, stippleHeight);
+	KPixmapEffect::gradient(stipple,
+			satColor,
+			satColor.dark(150),
+			KPixmapEffect::VerticalGradient);
+	stipple.setMask(mask);
+
+	// The active titlebar background below it, as drawn by paintEvent
+	TQColor c1 = options()->color(ColorTitleBar, true);
+	TQColor c1Blend = options()->color(ColorTitleBlend, true);
+	bool highcolor = useGradients && (TQPixmap::defaultDepth() > 8);
+
+	KPixmap* tile = new KPixmap();
+	tile->resize(STIPPLE_TILE_WIDTH, tileHeight);
+
+	TQPainter p(tile);
+	const KPixmap* strip = NULL;
+	if (highcolor && c1 != c1Blend)
+		strip = gradientCache->strip(titleHeight + TOP_GRABBAR_WIDTH,
+			c1Blend, c1, true);
+	if (strip)
+		p.drawTiledPixmap(0, 0, STIPPLE_TILE_WIDTH, tileHeight, *strip);
+	else
+		p.fillRect(0, 0, STIPPLE_TILE_WIDTH, tileHeight, c1);
+	p.drawPixmap(0, 0, stipple);
+	p.end();
+
+	return tile;
+}
 
-	// Create titlebar gradient images if required
-	aUpperGradient = NULL;
-	iUpperGradient = NULL;
 
-	// Set the sticky pin pixmaps;
+// Set the sticky pin pixmaps
+void BlueCurveHandler::createPins()
+{
 	TQColorGroup g;
 	TQPainter p;
 
@@ -254,11 +517,13 @@ void BlueCurveHandler::createPixmaps()
 		pindown_gray_bits, NULL, NULL, pindown_dgray_bits, NULL );
 	p.end();
 	ipinDownPix->setMask( TQBitmap(BASE_BUTTON_SIZE, BASE_BUTTON_SIZE, pindown_mask_bits, true) );
+}
 
-	// Create a title buffer for flicker-free painting
-	titleBuffer = new KPixmap();
 
-	// Cache all possible button states
+// Cache all possible button states
+void BlueCurveHandler::createButtonBackgrounds()
+{
+	TQColorGroup g;
 
 	btnUpPix = new KPixmap();
 	btnUpPix->resize(BASE_BUTTON_SIZE, BASE_BUTTON_SIZE);
@@ -279,16 +544,24 @@ void BlueCurveHandler::createPixmaps()
 
 	drawButtonBackground( ibtnUpPix, g, false, false );
 	drawButtonBackground( ibtnDownPix, g, true, false );
+}
 
+
+// Recolor the bottom corners
+void BlueCurveHandler::createCorners()
+{
 	TQImage bottomleft(bottom_left_xpm);
 	TQImage bottomright(bottom_right_xpm);
 	TQImage abottomleft(bottom_left_xpm);
 	TQImage abottomright(bottom_right_xpm);
 
-	recolor(bottomleft, options()->color( ColorTitleBar, false ).light(95));
-	recolor(bottomright, options()->color( ColorTitleBar, false ).light(95));
-	recolor(abottomleft, options()->color( ColorTitleBar, true ).light(135));
-	recolor(abottomright, options()->color( ColorTitleBar, true ).light(135));
+	// One lookup table per target color
+	Recolorer inactiveCorner( options()->color( ColorTitleBar, false ).light(95) );
+	Recolorer activeCorner( options()->color( ColorTitleBar, true ).light(135) );
+	inactiveCorner.apply( bottomleft );
+	inactiveCorner.apply( bottomright );
+	activeCorner.apply( abottomleft );
+	activeCorner.apply( abottomright );
 
 	bottomLeftPix 	= new TQPixmap();
 	bottomRightPix	= new TQPixmap();
@@ -300,66 +573,216 @@ void BlueCurveHandler::createPixmaps()
 	abottomRightPix->convertFromImage(abottomright);
 }
 
-// This is the recoloring method from the Keramik widget style,
-// copyright (c) 2002 Malte Starostik <malte@kde.org>.
-// Modified to work with 8bpp images.
-void BlueCurveHandler::recolor( TQImage &img, const TQColor& color )
+// Maps a decoration bitmap to its ButtonGlyph, or -1 if it has none.
+static int glyphForBitmap( const unsigned char *bitmap )
+{
+	if ( bitmap == menu_bits )
+		return GlyphMenu;
+	if ( bitmap == question_bits )
+		return GlyphHelp;
+	if ( bitmap == iconify_bits )
+		return GlyphIconify;
+	if ( bitmap == maximize_bits )
+		return GlyphMaximize;
+	if ( bitmap == minmax_bits )
+		return GlyphRestore;
+	if ( bitmap == close_bits )
+		return GlyphClose;
+	return -1;
+}
+
+
+static const unsigned char *bitmapForGlyph( int glyph )
+{
+	switch ( glyph )
+	{
+		case GlyphMenu:     return menu_bits;
+		case GlyphHelp:     return question_bits;
+		case GlyphIconify:  return iconify_bits;
+		case GlyphMaximize: return maximize_bits;
+		case GlyphRestore:  return minmax_bits;
+		case GlyphClose:    return close_bits;
+		default:            return NULL;
+	}
+}
+
+
+// Renders every glyph in every state once, so painting a button is a
+// single blit without any image conversion.
+void BlueCurveHandler::createButtonAtlas()
+{
+	for ( int glyph = 0; glyph < GlyphCount; glyph++ )
+		for ( int state = 0; state < AtlasStateCount; state++ )
+		{
+			buttonAtlas[glyph][state] = new KPixmap();
+			renderButtonState( buttonAtlas[glyph][state], glyph, state );
+		}
+}
+
+
+void BlueCurveHandler::renderButtonState( KPixmap *pix, int glyph, int state )
 {
-	int hue = -1, sat = 0, val = 228;
-	if ( color.isValid() )
-		color.hsv( &hue, &sat, &val );
-	int pixels = (img.depth() > 8 ? img.width() * img.height() : img.numColors());
-	TQ_UINT32* data = ( img.depth() > 8 ? reinterpret_cast< TQ_UINT32* >( img.bits() ) :
-		reinterpret_cast< TQ_UINT32* >( img.colorTable() ) );
-	
-	for ( int i = 0; i < pixels; i++ )
+	bool active = state & AtlasActive;
+	bool down   = state & AtlasDown;
+	bool hover  = state & AtlasHover;
+	bool large  = !(state & AtlasSmall);
+
+	// Sticky pins are drawn without a button background
+	if ( glyph == GlyphPinUp || glyph == GlyphPinDown )
+	{
+		KPixmap btnpix;
+		if ( active )
+			btnpix = (glyph == GlyphPinDown) ? *pinDownPix : *pinUpPix;
+		else
+			btnpix = (glyph == GlyphPinDown) ? *ipinDownPix : *ipinUpPix;
+
+		if ( hover )
+			btnpix = KPixmapEffect::intensity( btnpix, 0.8 );
+
+		if ( !large )
+			btnpix.convertFromImage( btnpix.convertToImage().smoothScale(14, 14) );
+
+		*pix = btnpix;
+		return;
+	}
+
+	KPixmap btnbg;
+	if ( down )
+		btnbg = active ? *btnDownPix : *ibtnDownPix;
+	else
+		btnbg = active ? *btnUpPix : *ibtnUpPix;
+
+	if ( hover )
+		KPixmapEffect::intensity( btnbg, 0.8 );
+
+	if ( !large )
+	{
+		btnbg.detach();
+		btnbg.convertFromImage( btnbg.convertToImage().smoothScale(14, 14) );
+	}
+
+	TQBitmap deco( 14, 14, bitmapForGlyph( glyph ), true );
+	deco.setMask( deco );
+
+	int off = (BASE_BUTTON_SIZE - 14) / 2;
+	int decoOff = down ? off + 1 : off;
+
+	pix->resize( BASE_BUTTON_SIZE, BASE_BUTTON_SIZE );
+	pix->fill( options()->color( ColorButtonBg, active ) );
+
+	// Select the appropriate button decoration color
+	bool darkDeco = tqGray( options()->color( ColorButtonBg, active ).rgb() ) > 127;
+	TQColor bgc = options()->color( ColorTitleBar, active );
+
+	TQPainter p( pix );
+	p.drawPixmap( 0, 0, btnbg );
+	if ( hover )
+		p.setPen( darkDeco ? bgc.dark(120) : bgc.light(120) );
+	else
+		p.setPen( darkDeco ? bgc.dark(150) : bgc.light(150) );
+	p.drawPixmap( decoOff, decoOff, deco );
+	p.end();
+
+	// Small buttons only cover the scaled background and the glyph,
+	// leave the rest of the button transparent as before.
+	if ( !large )
 	{
-		TQColor c( *data );
-		int h, s, v;
-		c.hsv( &h, &s, &v );
-		h = hue;
-		s = sat;
-		v = v * val / 145;
-		c.setHsv( h, TQMIN( s, 255 ), TQMIN( v, 255 ) );
-		*data = ( c.rgb() & TQT_RGB_MASK ) | ( *data & ~TQT_RGB_MASK );
-		data++;
+		TQBitmap mask( BASE_BUTTON_SIZE, BASE_BUTTON_SIZE, true );
+		TQPainter mp( &mask );
+		mp.fillRect( 0, 0, btnbg.width(), btnbg.height(), TQt::color1 );
+		mp.setPen( TQt::color1 );
+		mp.drawPixmap( decoOff, decoOff, deco );
+		mp.end();
+		pix->setMask( mask );
 	}
 }
 
 
-void BlueCurveHandler::freePixmaps()
+// Recolors an image with the Keramik recoloring method, see Recolorer.
+void BlueCurveHandler::recolor( TQImage &img, const TQColor& color )
+{
+	Recolorer( color ).apply( img );
+}
+
+
+#define FREE_PIXMAP(pix) \
+	if (pix) { \
+		delete pix; \
+		pix = NULL; \
+	}
+
+void BlueCurveHandler::freePixmaps( unsigned long assets )
 {
 	// Free button pixmaps
-	if (btnUpPix)
-		delete btnUpPix;
-	if(btnDownPix)
-		delete btnDownPix;
-	if (ibtnUpPix)
-		delete ibtnUpPix;
-	if (ibtnDownPix)
-		delete ibtnDownPix;
+	if (assets & AssetButtons)
+	{
+		FREE_PIXMAP(btnUpPix);
+		FREE_PIXMAP(btnDownPix);
+		FREE_PIXMAP(ibtnUpPix);
+		FREE_PIXMAP(ibtnDownPix);
+
+		// Button atlas
+		for (int glyph = 0; glyph < GlyphCount; glyph++)
+			for (int state = 0; state < AtlasStateCount; state++)
+				FREE_PIXMAP(buttonAtlas[glyph][state]);
+	}
 
 	// Title images
-	if (titleBuffer)
-		delete titleBuffer;
-	if (titlePix)
-		delete titlePix;
-	if (aUpperGradient)
-		delete aUpperGradient;
-	if (iUpperGradient)
-		delete iUpperGradient;
+	if (assets & AssetStipple)
+	{
+		FREE_PIXMAP(stippleTile);
+		FREE_PIXMAP(toolStippleTile);
+	}
+	if (assets & AssetGradients)
+		FREE_PIXMAP(gradientCache);
 
 	// Sticky pin images
-	if (pinUpPix)
-		delete pinUpPix;
-	if (ipinUpPix)
-		delete ipinUpPix;
-	if (pinDownPix)
-		delete pinDownPix;
-	if (ipinDownPix)
-		delete ipinDownPix;
+	if (assets & AssetPins)
+	{
+		FREE_PIXMAP(pinUpPix);
+		FREE_PIXMAP(ipinUpPix);
+		FREE_PIXMAP(pinDownPix);
+		FREE_PIXMAP(ipinDownPix);
+	}
+
+	// Bottom corners and the shape cut out of them
+	if (assets & AssetCorners)
+	{
+		FREE_PIXMAP(bottomLeftPix);
+		FREE_PIXMAP(bottomRightPix);
+		FREE_PIXMAP(abottomLeftPix);
+		FREE_PIXMAP(abottomRightPix);
+		if (shapeCorners)
+		{
+			delete [] shapeCorners;
+			shapeCorners = NULL;
+		}
+		FREE_PIXMAP(cornerAlpha);
+
+		// Cut from a frame with the old colors and corners
+		DecorationRenderer::freeFrameTiles();
+	}
+
+	if (assets & AssetShadows)
+	{
+		FREE_PIXMAP(shadowTiles[0]);
+		FREE_PIXMAP(shadowTiles[1]);
+	}
+
+	// Only freed when the handler goes away
+	if (assets == AssetAll)
+	{
+		FREE_PIXMAP(titleBuffer);
+		if (buttonShapes)
+		{
+			delete [] buttonShapes;
+			buttonShapes = NULL;
+		}
+	}
 }
 
+#undef FREE_PIXMAP
+
 
 void BlueCurveHandler::drawButtonBackground(KPixmap *pix, 
 		const TQColorGroup &g, bool sunken, bool active)
@@ -380,10 +803,19 @@ void BlueCurveHandler::drawButtonBackground(KPixmap *pix,
 		{
 			TQColor inactiveTitleColor1(options()->color(ColorTitleBar, false));
 			TQColor inactiveTitleColor2(options()->color(ColorTitleBlend, false));
-			KPixmapEffect::gradient(*pix,
-				inactiveTitleColor2,
-				inactiveTitleColor1,
-				KPixmapEffect::VerticalGradient);
+			const KPixmap* strip = useGradientStrips ?
+				gradientCache->strip(pix->height(), inactiveTitleColor2,
+					inactiveTitleColor1, false) : NULL;
+			if (strip)
+			{
+				p.begin(pix);
+				p.drawTiledPixmap(0, 0, pix->width(), pix->height(), *strip);
+				p.end();
+			} else
+				KPixmapEffect::gradient(*pix,
+					inactiveTitleColor2,
+					inactiveTitleColor1,
+					KPixmapEffect::VerticalGradient);
 		}
 	} else
 		pix->fill(c);
@@ -403,7 +835,8 @@ BlueCurveButton::BlueCurveButton(BlueCurveClient *parent, const char *name,
 	setToggleButton( isOnAllDesktopsButton );
 
 	isMouseOver = false;
-	deco = NULL;
+	shapedPos = -1;
+	glyph = isOnAllDesktopsButton ? GlyphPinUp : -1;
 	large = largeButton;
 	isOnAllDesktops = isOnAllDesktopsButton;
 	client = parent;
@@ -421,8 +854,6 @@ BlueCurveButton::BlueCurveButton(BlueCurveClient *parent, const char *name,
 
 BlueCurveButton::~BlueCurveButton()
 {
-	if (deco)
-		delete deco;
 }
 
 
@@ -443,14 +874,12 @@ void BlueCurveButton::showEvent(TQShowEvent *)
 	doShape();
 }
 
-void BlueCurveButton::doShape()
+// Paints the mask of a button at the given position
+static TQBitmap buttonShapeBitmap( int pos, int w, int h )
 {
-	// Obtain widget bounds.
-	int w  = rect() .width();
-	int h  = rect().height();
 	int r = BUTTON_DIAM / 2;
 	int dm = BUTTON_DIAM;
-	TQBitmap mask(size(), true);
+	TQBitmap mask(w, h, true);
 
 	TQPainter p3(&mask);
 	TQBrush blackbr(TQt::color1);
@@ -469,97 +898,78 @@ void BlueCurveButton::doShape()
 			p3.drawArc(w-dm, -TOP_GRABBAR_WIDTH, dm-1, dm-1, 0*16, 90*16);
 		}
 	p3.end();
-	setMask(mask);
+	return mask;
 }
 
-void BlueCurveButton::setBitmap(const unsigned char *bitmap)
-{
-	if (deco)
-		delete deco;
 
-	deco = new TQBitmap(14, 14, bitmap, true);
-	deco->setMask( *deco );
-	repaint( false );
+// Only the outer buttons have a rounded corner. Their masks are the same
+// for every window, so build them once and share them.
+void BlueCurveHandler::createButtonShapes()
+{
+	buttonShapes = new TQRegion[2];
+	buttonShapes[0] = TQRegion( buttonShapeBitmap( ButtonLeft,
+		BASE_BUTTON_SIZE, BASE_BUTTON_SIZE ) );
+	buttonShapes[1] = TQRegion( buttonShapeBitmap( ButtonRight,
+		BASE_BUTTON_SIZE, BASE_BUTTON_SIZE ) );
 }
 
 
-void BlueCurveButton::drawButton(TQPainter *p)
+void BlueCurveButton::doShape()
 {
-	if (!BlueCurve_initialized)
+	bool rounded = (pos == ButtonLeft || pos == ButtonRight);
+
+	// Nothing changed since the last time
+	if (pos == shapedPos && size() == shapedSize)
 		return;
 
-	if (deco)
+	if (!rounded)
 	{
-		// Fill the button background with an appropriate button image
-		KPixmap btnbg;
-
-		if (isDown())
-			btnbg = client->isActive() ? *btnDownPix : *ibtnDownPix;
-		else
-			btnbg = client->isActive() ? *btnUpPix : *ibtnUpPix;
-      
-		if (isMouseOver)
-			KPixmapEffect::intensity(btnbg, 0.8);
-
-		// Scale the background image if required
-		// This is slow, but we assume this isn't done too often
-		if ( !large )
-		{
-			btnbg.detach();
-			btnbg.convertFromImage(btnbg.convertToImage().smoothScale(14, 14));
-		}
-
-		p->drawPixmap( 0, 0, btnbg );
+		// Middle buttons are plain rectangles
+		if (shapedPos == ButtonLeft || shapedPos == ButtonRight)
+			clearMask();
+	} else if (size() == TQSize(BASE_BUTTON_SIZE, BASE_BUTTON_SIZE))
+		setMask( buttonShapes[pos == ButtonLeft ? 0 : 1] );
+	else
+		setMask( buttonShapeBitmap( pos, width(), height() ) );
 
-	}
+	shapedPos = pos;
+	shapedSize = size();
+}
 
-	// If we have a decoration bitmap, then draw that
-	// otherwise we paint a menu button (with mini icon), or a sticky button.
-	if ( deco )
-	{
-		// Select the appropriate button decoration color
-		bool darkDeco = tqGray( KDecoration::options()->color(
-				KDecoration::ColorButtonBg,
-				client->isActive()).rgb() ) > 127;
-
-		TQColor bgc = KDecoration::options()->color(KDecoration::ColorTitleBar, client->isActive());
-		if (isMouseOver)
-			p->setPen( darkDeco ? bgc.dark(120) : bgc.light(120) );
-		else
-			p->setPen( darkDeco ? bgc.dark(150) : bgc.light(150) );
+void BlueCurveButton::setBitmap(const unsigned char *bitmap)
+{
+	glyph = glyphForBitmap( bitmap );
+	repaint( false );
+}
 
-		int xOff = (width()-14)/2;
-		int yOff = (height()-14)/2;
-		p->drawPixmap(isDown() ? xOff+1: xOff, isDown() ? yOff+1 : yOff, *deco);
-	} else
-	{
-		KPixmap btnpix;
 
-		if (isOnAllDesktops)
-		{
-			if (client->isActive())
-				btnpix = isOn() ? *pinDownPix : *pinUpPix;
-			else
-				btnpix = isOn() ? *ipinDownPix : *ipinUpPix;
-		} else
-		{
-			btnpix = client->icon().pixmap( TQIconSet::Small, TQIconSet::Normal );
-        }
-      
-		// Intensify the image if required
-		if (isMouseOver)
-			btnpix = KPixmapEffect::intensity(btnpix, 0.8);
-      
-		// Smooth scale the pixmap for small titlebars
-		// This is slow, but we assume this isn't done too often
-		if ( !large )
-			btnpix.convertFromImage(btnpix.convertToImage().smoothScale(14, 14));
-      
-		p->drawPixmap( 0, 0, btnpix );
-	}
+void BlueCurveButton::drawButton(TQPainter *p)
+{
+	if (!BlueCurve_initialized)
+		return;
 
-	TQColorGroup g;
-	p->setPen(g.dark());
+	StatTimer timer( StatButtonPaint );
+	client->traceButtonEvent( this, TraceButtonPaint );
+
+	// Glyph buttons and sticky pins come straight from the atlas,
+	// otherwise we paint a menu button with the mini icon.
+	DecorationButton b;
+	b.glyph = glyph;
+	b.on = isOn();
+	if (client->isActive())
+		b.state |= AtlasActive;
+	if (isDown())
+		b.state |= AtlasDown;
+	if (isMouseOver)
+		b.state |= AtlasHover;
+	if (!large)
+		b.state |= AtlasSmall;
+	if (glyph < 0)
+		b.icon = client->menuIcon( isMouseOver, !large );
+
+	BLUECURVE_PROBE2( button_entry, glyph, b.state );
+	p->drawPixmap( 0, 0, DecorationRenderer::buttonPixmap( b ) );
+	BLUECURVE_PROBE2( button_return, glyph, b.state );
 }
 
 
@@ -574,6 +984,7 @@ void BlueCurveButton::turnOn( bool isOn )
 void BlueCurveButton::enterEvent(TQEvent *e) 
 { 
 	isMouseOver=true;
+	client->traceButtonEvent( this, TraceHover );
 	repaint(false); 
 	TQButton::enterEvent(e);
 }
@@ -582,6 +993,7 @@ void BlueCurveButton::enterEvent(TQEvent *e)
 void BlueCurveButton::leaveEvent(TQEvent *e)
 { 
 	isMouseOver=false;
+	client->traceButtonEvent( NULL, TraceHover );
 	repaint(false); 
 	TQButton::leaveEvent(e);
 }
@@ -590,6 +1002,7 @@ void BlueCurveButton::leaveEvent(TQEvent *e)
 void BlueCurveButton::mousePressEvent( TQMouseEvent* e )
 {
 	last_button = e->button();
+	client->traceButtonEvent( this, TracePress, e->button() );
 	TQMouseEvent me( e->type(), e->pos(), e->globalPos(),
 			(e->button()&realizeButtons)?LeftButton:NoButton, e->state() );
 	TQButton::mousePressEvent( &me );
@@ -599,6 +1012,7 @@ void BlueCurveButton::mousePressEvent( TQMouseEvent* e )
 void BlueCurveButton::mouseReleaseEvent( TQMouseEvent* e )
 {
 	last_button = e->button();
+	client->traceButtonEvent( this, TraceRelease, e->button() );
 	TQMouseEvent me( e->type(), e->pos(), e->globalPos(),
 			(e->button()&realizeButtons)?LeftButton:NoButton, e->state() );
 	TQButton::mouseReleaseEvent( &me );
@@ -623,6 +1037,30 @@ void BlueCurveButton::setTipText(const TQString &tip) {
 BlueCurveClient::BlueCurveClient( KDecorationBridge* bridge, KDecorationFactory* factory )
 		: KDecoration (bridge, factory)
 {
+	for (int i = 0; i < 4; i++)
+		m_menuIconValid[i] = false;
+
+	m_titleFontValid = false;
+	m_argb = false;
+	m_shaped = false;
+	m_shadow = 0;
+
+	for (int i = 0; i < SectionCount; i++)
+		m_sections[i] = NULL;
+
+	m_captionDirty = false;
+	m_closing = false;
+	connect( &m_captionTimer, TQ_SIGNAL(timeout()), this, TQ_SLOT(flushCaption()) );
+
+	m_traceId = ++nextTraceId;
+	m_traceGeneration = 0;
+}
+
+
+BlueCurveClient::~BlueCurveClient()
+{
+	if (traceRecorder && m_traceGeneration == traceRecorder->generation())
+		traceRecorder->destroy( m_traceId );
 }
 
 
@@ -639,6 +1077,24 @@ void BlueCurveClient::init()
 	for(int i=0; i < BlueCurveClient::BtnCount; i++)
 		button[i] = NULL;
 
+	if (serverSideBackground)
+		createSections();
+
+	// Only the preview has a widget in place of the client window
+	if (isPreview())
+		m_label = new TQLabel( i18n( "<center><b>Bluecurve preview</b></center>" ), widget());
+	else
+		m_label = NULL;
+
+	createButtons();
+}
+
+
+// Builds the titlebar buttons and the list of titlebar items that
+// updateGeometry() lays out. Called once from init() and again by
+// reset() when the buttons or sizes change.
+void BlueCurveClient::createButtons()
+{
 	// Finally, toolWindows look small
 	if ( isTool() ) {
 		titleHeight  = toolTitleHeight;
@@ -648,61 +1104,165 @@ void BlueCurveClient::init()
 		largeButtons = true;
 	}
 
-	// Pack the windowWrapper() window within a grid
-	TQVBoxLayout* g = new TQVBoxLayout(widget());
-	g->setResizeMode(TQLayout::FreeResize);
-	g->addSpacing(TOP_GRABBAR_WIDTH);       // Top grab bar
-
-	// Pack the titlebar HBox with items
-	hb = new TQHBoxLayout();
-	hb->setSpacing(0);
-	hb->setMargin(0);
-	hb->setResizeMode( TQLayout::FreeResize );
+	// The button mode is fixed until the buttons are recreated. Button
+	// windows would need shapes of their own, so transparent corners
+	// come with windowless buttons.
+	m_argb = compositing && !serverSideBackground && cornerAlpha
+		&& cornerAlpha->usable( widget() );
+	m_windowless = windowlessButtons || m_argb;
+	m_shadow = (m_argb && shadowTiles[0] && shadowTiles[1]) ? shadowTiles[0]->size() : 0;
+	for (int i = 0; i < BlueCurveClient::BtnCount; i++)
+	{
+		m_buttons[i].used = false;
+		m_buttons[i].hidden = false;
+	}
+	m_hoverButton = -1;
+	m_pressedButton = -1;
+	m_lastButton = LeftButton;
+	widget()->setMouseTracking( m_windowless );
+	TQToolTip::remove( widget() );
+	if (titleWidget() != widget())
+	{
+		titleWidget()->setMouseTracking( m_windowless );
+		TQToolTip::remove( titleWidget() );
+	}
 
-	hb->addSpacing(2);
+	m_titleItems.clear();
+	m_titleItems.append( -2 );
 	addClientButtons( options()->titleButtonsLeft(), true );
-	titlebar = new TQSpacerItem( 10, titleHeight,
-		TQSizePolicy::Expanding, TQSizePolicy::Minimum );
-	hb->addItem(titlebar);
-
-	//hb->addSpacing(2);
+	m_titleItems.append( TitleSlot );
 	addClientButtons( options()->titleButtonsRight(), false );
-	hb->addSpacing(2);
-
-	g->addLayout( hb );
-	g->addSpacing(1); // line under titlebar
-
-	// Add the middle section
-	hb = new TQHBoxLayout();
-	hb->addSpacing(BORDER_WIDTH);
-	if (isPreview())
-		hb->addWidget(new TQLabel( i18n( "<center><b>Bluecurve preview</b></center>" ), widget()));
-	else
-		hb->addWidget(new TQLabel("", widget()));
-	hb->addSpacing(BORDER_WIDTH);
-	g->addLayout( hb );
+	m_titleItems.append( -2 );
 
-	// Determine the size of the lower grab bar
-	if ( showGrabBar && (!isTool()) )
-		g->addSpacing(BORDER_WIDTH); // bottom handles
-	else
-		g->addSpacing(4); // bottom handles
+	m_titleRect = TQRect();
+	m_geometryWidth = -1;
+	m_geometryDirty = true;
 }
 
 
-bool BlueCurveClient::isTool() const
+// Places the buttons and the caption area. Apart from hidden buttons
+// this only depends on the width, so the result is kept until either
+// changes. The titlebar row is at least as tall as the buttons, which
+// sit at its top.
+void BlueCurveClient::updateGeometry()
 {
-	NET::WindowType type = windowType(NET::NormalMask|NET::ToolbarMask|NET::UtilityMask|NET::MenuMask);
-	return ((type==NET::Toolbar)||(type==NET::NET::Utility)||(type==NET::Menu));
+	int w = width();
+	int rowHeight = TQMAX( titleHeight, BASE_BUTTON_SIZE );
+
+	if (m_sections[SectionTop])
+		for (int i = 0; i < SectionCount; i++)
+			if (m_sections[i]->geometry() != sectionRect( i ))
+				m_sections[i]->setGeometry( sectionRect( i ) );
+
+	// The preview label covers the client area
+	if (m_label)
+	{
+		int top = TOP_GRABBAR_WIDTH + rowHeight + 1;
+		int bottom = (showGrabBar && !isTool()) ? BORDER_WIDTH : 4;
+		m_label->setGeometry( toWidget( TQRect( BORDER_WIDTH, top,
+			w - 2*BORDER_WIDTH, height() - top - bottom ) ) );
+	}
+
+	if (w == m_geometryWidth && !m_geometryDirty)
+		return;
+	m_geometryWidth = w;
+	m_geometryDirty = false;
+
+	// The caption area takes whatever the buttons and spacings leave
+	TQValueList<int>::ConstIterator it;
+	int fixed = 0;
+	for (it = m_titleItems.begin(); it != m_titleItems.end(); ++it)
+	{
+		if (*it < 0)
+			fixed -= *it;
+		else if (*it != TitleSlot && !m_buttons[*it].hidden)
+			fixed += BASE_BUTTON_SIZE;
+	}
+
+	int x = 0;
+	for (it = m_titleItems.begin(); it != m_titleItems.end(); ++it)
+	{
+		int item = *it;
+		if (item < 0)
+			x -= item;
+		else if (item == TitleSlot)
+		{
+			int tw = TQMAX( w - fixed, 0 );
+			m_titleRect = TQRect( x, TOP_GRABBAR_WIDTH, tw, rowHeight );
+			x += tw;
+		} else if (!m_buttons[item].hidden)
+		{
+			m_buttons[item].rect = TQRect( x, TOP_GRABBAR_WIDTH,
+				BASE_BUTTON_SIZE, BASE_BUTTON_SIZE );
+			if (button[item])
+				button[item]->setGeometry( m_buttons[item].rect );
+			x += BASE_BUTTON_SIZE;
+		}
+	}
+
+	if (m_windowless)
+		updateButtonTips();
+
+	if (traceRecorder)
+		traceGeometry();
 }
 
 
-void BlueCurveClient::addClientButtons( const TQString& s, bool isLeft )
+// Applies a configuration change without recreating the decoration.
+void BlueCurveClient::reset( unsigned long changed )
 {
-	int pos;
-	// Make sure we place the spacing between the buttons
-	bool first_button = true;
-	BlueCurveButton* last_button = NULL;
+	// Colors, fonts and title sizes all end up in the cached caption
+	// and titlebars
+	if (changed & SettingFont)
+		m_titleFontValid = false;
+	m_renderer.invalidate();
+
+	if (changed & SettingBlueCurveBackground)
+	{
+		deleteSections();
+		if (serverSideBackground)
+			createSections();
+	}
+
+	if (changed & (SettingButtons | SettingTooltips | SettingBlueCurveTitleSize
+		| SettingBlueCurveGrabBar | SettingBlueCurveButtonMode
+		| SettingBlueCurveBackground | SettingBlueCurveCorners
+		| SettingBlueCurveShadow))
+	{
+		for(int i=0; i < BlueCurveClient::BtnCount; i++)
+		{
+			delete button[i];
+			button[i] = NULL;
+		}
+
+		createButtons();
+		calcHiddenButtons();
+		doShape();
+	} else
+	{
+		// Pick up the new button atlas
+		for(int i=BlueCurveClient::BtnHelp; i < BlueCurveClient::BtnCount; i++)
+			if(button[i])
+				button[i]->repaint(false);
+	}
+
+	widget()->repaint(false);
+}
+
+
+bool BlueCurveClient::isTool() const
+{
+	NET::WindowType type = windowType(NET::NormalMask|NET::ToolbarMask|NET::UtilityMask|NET::MenuMask);
+	return ((type==NET::Toolbar)||(type==NET::NET::Utility)||(type==NET::Menu));
+}
+
+
+void BlueCurveClient::addClientButtons( const TQString& s, bool isLeft )
+{
+	int pos;
+	// Make sure we place the spacing between the buttons
+	bool first_button = true;
+	int last_button = -1;
 
 	if (s.length() > 0) {
 		for(unsigned int i = 0; i < s.length(); i++) {
@@ -715,149 +1275,440 @@ void BlueCurveClient::addClientButtons( const TQString& s, bool isLeft )
 			{
 				// Menu button
 				case 'M':
-					if (!button[BtnMenu])
+					if (!hasButton(BtnMenu))
 					{
-						button[BtnMenu] = new BlueCurveButton(this, "menu",
-							largeButtons, pos, false, menu_bits, i18n("Menu"), LeftButton|RightButton);
-						connect( button[BtnMenu], TQ_SIGNAL(pressed()),
-							this, TQ_SLOT(menuButtonPressed()) );
-						connect( button[BtnMenu], TQ_SIGNAL(released()),
-							this, TQ_SLOT(menuButtonReleased()));
 						if (! first_button)
-							hb->addSpacing(2);
+							m_titleItems.append(-2);
 						else
 							first_button = false;
-						hb->addWidget( button[BtnMenu] );
-						last_button = button[BtnMenu];
+						addButton( BtnMenu, "menu", pos, false, menu_bits,
+							i18n("Menu"), LeftButton|RightButton );
+						last_button = BtnMenu;
 					}
 					break;
 
 				// Sticky button
 				case 'S':
-					if (!button[BtnOnAllDesktops])
+					if (!hasButton(BtnOnAllDesktops))
 					{
-						button[BtnOnAllDesktops] = new BlueCurveButton(this, "on_all_desktops", 
-							largeButtons, pos, true, NULL, i18n("On All Desktops"));
-						button[BtnOnAllDesktops]->turnOn( isOnAllDesktops() );
-						connect( button[BtnOnAllDesktops], TQ_SIGNAL(clicked()), 
-							this, TQ_SLOT(toggleOnAllDesktops()) );
-						hb->addSpacing(2);
-						hb->addWidget( button[BtnOnAllDesktops] );
-						last_button = button[BtnOnAllDesktops];
+						m_titleItems.append(-2);
+						addButton( BtnOnAllDesktops, "on_all_desktops", pos, true,
+							NULL, i18n("On All Desktops") );
+						last_button = BtnOnAllDesktops;
 					}
 					break;
 
 				// Help button
 				case 'H':
-					if( providesContextHelp() && (!button[BtnHelp]) )
+					if( providesContextHelp() && (!hasButton(BtnHelp)) )
 					{
-						button[BtnHelp] = new BlueCurveButton(this, "help",
-							largeButtons, pos, true, question_bits,
-							i18n("Help"));
-						connect( button[BtnHelp], TQ_SIGNAL( clicked() ),
-							this, TQ_SLOT( contextHelp() ));
 						if (! first_button)
-							hb->addSpacing(2);
+							m_titleItems.append(-2);
 						else
 							first_button = false;
-						hb->addWidget( button[BtnHelp] );
-						last_button = button[BtnHelp];
+						addButton( BtnHelp, "help", pos, true, question_bits,
+							i18n("Help") );
+						last_button = BtnHelp;
 					}
 					break;
 
 				// Minimize button
 				case 'I':
-					if ( (!button[BtnIconify]) && isMinimizable())
+					if ( (!hasButton(BtnIconify)) && isMinimizable())
 					{
-						button[BtnIconify] = new BlueCurveButton(this, "iconify",
-							largeButtons, pos, false, iconify_bits,
-							i18n("Minimize"));
-						connect( button[BtnIconify], TQ_SIGNAL( clicked()),
-							this, TQ_SLOT(minimize()) );
 						if (! first_button)
-							hb->addSpacing(2);
+							m_titleItems.append(-2);
 						else
 							first_button = false;
-						hb->addWidget( button[BtnIconify] );
-						last_button = button[BtnIconify];
+						addButton( BtnIconify, "iconify", pos, false, iconify_bits,
+							i18n("Minimize") );
+						last_button = BtnIconify;
 					}
 					break;
 
 				// Maximize button
 				case 'A':
-				if ( (!button[BtnMax]) && isMaximizable())
+				if ( (!hasButton(BtnMax)) && isMaximizable())
 				{
-					button[BtnMax]  = new BlueCurveButton(this, "maximize",
-						largeButtons, pos, false, maximize_bits,
-						i18n("Maximize"), LeftButton|MidButton|RightButton);
-					connect( button[BtnMax], TQ_SIGNAL( clicked()),
-						this, TQ_SLOT(slotMaximize()) );
 					if (! first_button)
-						hb->addSpacing(2);
+						m_titleItems.append(-2);
 					else
 						first_button = false;
-					hb->addWidget( button[BtnMax] );
-					last_button = button[BtnMax];
+					addButton( BtnMax, "maximize", pos, false, maximize_bits,
+						i18n("Maximize"), LeftButton|MidButton|RightButton );
+					last_button = BtnMax;
 				}
 				break;
 
 				// Close button
 				case 'X':
-				if (!button[BtnClose])
+				if (!hasButton(BtnClose))
 				{
-					button[BtnClose] = new BlueCurveButton(this, "close",
-						largeButtons, pos, false, close_bits,
-						i18n("Close"));
-					connect( button[BtnClose], TQ_SIGNAL( clicked()),
-						this, TQ_SLOT(closeWindow()) );
 					if (! first_button)
-						hb->addSpacing(2);
+						m_titleItems.append(-2);
 					else
 						first_button = false;
-					hb->addWidget( button[BtnClose] );
-					last_button = button[BtnClose];
+					addButton( BtnClose, "close", pos, false, close_bits,
+						i18n("Close") );
+					last_button = BtnClose;
 				}
 				break;
 
 				// Spacer item (only for non-tool windows)
 				case '_':
 				if ( !isTool() )
-					hb->addSpacing(2);
+					m_titleItems.append(-2);
 			}
 		}
 
-		if (last_button) {
-			if(not isLeft)
-				last_button->pos = ButtonRight;
-			else
-				last_button->pos = LeftButtonRight;
+		if (last_button >= 0) {
+			int lastPos = isLeft ? LeftButtonRight : ButtonRight;
+			m_buttons[last_button].pos = lastPos;
+			if (button[last_button])
+				button[last_button]->pos = lastPos;
 		}
 	}
 }
 
 
+// Appends button i to the titlebar. Unless the buttons are windowless,
+// it also gets a child widget.
+void BlueCurveClient::addButton( int i, const char* name, int pos, bool toggle,
+		const unsigned char* bitmap, const TQString& tip, int realizeBtns )
+{
+	TitleButton& b = m_buttons[i];
+	b.used = true;
+	b.glyph = bitmap ? glyphForBitmap( bitmap ) : GlyphPinUp;
+	b.pos = pos;
+	b.realizeButtons = realizeBtns;
+	b.on = (i == BtnOnAllDesktops) && isOnAllDesktops();
+	b.down = false;
+	b.hover = false;
+	b.hidden = false;
+	b.tip = tip;
+	m_titleItems.append( i );
+
+	if (m_windowless)
+		return;
+
+	button[i] = new BlueCurveButton( this, name, largeButtons, pos, toggle,
+		bitmap, tip, realizeBtns );
+
+	switch (i)
+	{
+		case BtnMenu:
+			connect( button[i], TQ_SIGNAL(pressed()),
+				this, TQ_SLOT(menuButtonPressed()) );
+			connect( button[i], TQ_SIGNAL(released()),
+				this, TQ_SLOT(menuButtonReleased()) );
+			break;
+		case BtnOnAllDesktops:
+			button[i]->turnOn( isOnAllDesktops() );
+			connect( button[i], TQ_SIGNAL(clicked()),
+				this, TQ_SLOT(toggleOnAllDesktops()) );
+			break;
+		case BtnHelp:
+			connect( button[i], TQ_SIGNAL(clicked()),
+				this, TQ_SLOT(contextHelp()) );
+			break;
+		case BtnIconify:
+			connect( button[i], TQ_SIGNAL(clicked()),
+				this, TQ_SLOT(minimize()) );
+			break;
+		case BtnMax:
+			connect( button[i], TQ_SIGNAL(clicked()),
+				this, TQ_SLOT(slotMaximize()) );
+			break;
+		case BtnClose:
+			connect( button[i], TQ_SIGNAL(clicked()),
+				this, TQ_SLOT(closeWindow()) );
+			break;
+	}
+}
+
+
+bool BlueCurveClient::hasButton( int i ) const
+{
+	return m_buttons[i].used;
+}
+
+
+bool BlueCurveClient::buttonVisible( int i ) const
+{
+	return m_buttons[i].used && !m_buttons[i].hidden;
+}
+
+
+int BlueCurveClient::buttonPos( int i ) const
+{
+	return m_buttons[i].pos;
+}
+
+
+TQRect BlueCurveClient::buttonGeometry( int i ) const
+{
+	return m_buttons[i].rect;
+}
+
+
+// Hidden buttons give their space to the caption area
+void BlueCurveClient::setButtonHidden( int i, bool hide )
+{
+	if (button[i])
+	{
+		if (hide && button[i]->isVisible())
+			button[i]->hide();
+		else if (!hide && !button[i]->isVisible())
+			button[i]->show();
+	}
+
+	if (m_buttons[i].used && m_buttons[i].hidden != hide)
+	{
+		m_buttons[i].hidden = hide;
+		m_geometryDirty = true;
+	}
+}
+
+
+void BlueCurveClient::setButtonTip( int i, const TQString& tip )
+{
+	if (button[i])
+		button[i]->setTipText( tip );
+	else if (m_buttons[i].used)
+	{
+		m_buttons[i].tip = tip;
+		updateButtonTips();
+	}
+}
+
+
+void BlueCurveClient::repaintButton( int i )
+{
+	if (button[i])
+		button[i]->repaint( false );
+	else if (buttonVisible( i ))
+		widget()->repaint( toWidget( buttonGeometry( i ) ), false );
+}
+
+
+// Returns the windowless button under p, or -1. The rounded corners of
+// the outer buttons belong to the titlebar.
+int BlueCurveClient::buttonAt( const TQPoint& p ) const
+{
+	for (int i = 0; i < BlueCurveClient::BtnCount; i++)
+	{
+		if (!buttonVisible( i ))
+			continue;
+
+		TQRect r = buttonGeometry( i );
+		if (!r.contains( p ))
+			continue;
+
+		int pos = m_buttons[i].pos;
+		if (pos == ButtonLeft || pos == ButtonRight)
+			return buttonShapes[pos == ButtonLeft ? 0 : 1].contains( p - r.topLeft() )
+				? i : -1;
+		return i;
+	}
+	return -1;
+}
+
+
+// The windowless counterpart of TQButton's mouse handling. Presses with
+// mouse buttons the button doesn't react to are swallowed, like there.
+bool BlueCurveClient::buttonPress( TQMouseEvent* e )
+{
+	int i = buttonAt( toFrame( e->pos() ) );
+	if (i < 0)
+		return false;
+
+	m_lastButton = e->button();
+	if (!(e->button() & m_buttons[i].realizeButtons))
+		return true;
+
+	TraceRecorder* t = tracer();
+	if (t)
+		t->press( m_traceId, traceButton( i ), e->button() );
+
+	m_pressedButton = i;
+	m_buttons[i].down = true;
+	repaintButton( i );
+
+	// May show the window menu or close the window
+	if (i == BtnMenu)
+		menuButtonPressed();
+	return true;
+}
+
+
+bool BlueCurveClient::buttonMove( TQMouseEvent* e )
+{
+	int i = buttonAt( toFrame( e->pos() ) );
+
+	// A pressed button is only down while the mouse is over it
+	if (m_pressedButton >= 0)
+	{
+		bool down = (i == m_pressedButton);
+		if (m_buttons[m_pressedButton].down != down)
+		{
+			m_buttons[m_pressedButton].down = down;
+			repaintButton( m_pressedButton );
+		}
+	}
+
+	setHoverButton( i );
+	return i >= 0 || m_pressedButton >= 0;
+}
+
+
+bool BlueCurveClient::buttonRelease( TQMouseEvent* e )
+{
+	int i = m_pressedButton;
+	if (i < 0)
+		return false;
+	if (!(e->button() & m_buttons[i].realizeButtons))
+		return true;
+
+	TraceRecorder* t = tracer();
+	if (t)
+		t->release( m_traceId, traceButton( i ), e->button() );
+
+	bool clicked = m_buttons[i].down;
+	m_lastButton = e->button();
+	m_pressedButton = -1;
+	m_buttons[i].down = false;
+	repaintButton( i );
+
+	// The actions may delete the decoration, so they come last
+	if (i == BtnMenu)
+		menuButtonReleased();
+	else if (clicked)
+		buttonClicked( i );
+	return true;
+}
+
+
+void BlueCurveClient::buttonClicked( int i )
+{
+	switch (i)
+	{
+		case BtnOnAllDesktops:
+			toggleOnAllDesktops();
+			break;
+		case BtnHelp:
+			contextHelp();
+			break;
+		case BtnIconify:
+			minimize();
+			break;
+		case BtnMax:
+			slotMaximize();
+			break;
+		case BtnClose:
+			closeWindow();
+			break;
+	}
+}
+
+
+void BlueCurveClient::setHoverButton( int i )
+{
+	if (i == m_hoverButton)
+		return;
+
+	TraceRecorder* t = tracer();
+	if (t)
+		t->hover( m_traceId, i >= 0 ? traceButton( i ) : -1 );
+
+	int old = m_hoverButton;
+	m_hoverButton = i;
+	if (old >= 0 && m_buttons[old].used)
+	{
+		m_buttons[old].hover = false;
+		repaintButton( old );
+	}
+	if (i >= 0)
+	{
+		m_buttons[i].hover = true;
+		repaintButton( i );
+	}
+}
+
+
+// Windowless buttons share the tooltips of the decoration widget, one
+// per button rectangle. Called whenever the buttons move.
+void BlueCurveClient::updateButtonTips()
+{
+	TQToolTip::remove( titleWidget() );
+	if (!options()->showTooltips())
+		return;
+
+	for (int i = 0; i < BlueCurveClient::BtnCount; i++)
+		if (buttonVisible( i ) && !m_buttons[i].tip.isEmpty())
+			TQToolTip::add( titleWidget(), toWidget( buttonGeometry( i ) ), m_buttons[i].tip );
+}
+
+
+// The application icon as shown on the menu button. The intensified and
+// scaled variants are only computed once per icon change.
+const KPixmap& BlueCurveClient::menuIcon( bool hover, bool small )
+{
+	int i = (hover ? 1 : 0) | (small ? 2 : 0);
+	if (m_menuIconValid[i])
+		return m_menuIcon[i];
+
+	KPixmap btnpix;
+	btnpix = icon().pixmap( TQIconSet::Small, TQIconSet::Normal );
+
+	// Intensify the image if required
+	if (hover)
+		btnpix = KPixmapEffect::intensity(btnpix, 0.8);
+
+	// Smooth scale the pixmap for small titlebars
+	if (small)
+		btnpix.convertFromImage(btnpix.convertToImage().smoothScale(14, 14));
+
+	m_menuIcon[i] = btnpix;
+	m_menuIconValid[i] = true;
+	return m_menuIcon[i];
+}
+
+
 void BlueCurveClient::iconChange()
 {
-	if (button[BtnMenu] && button[BtnMenu]->isVisible())
-		button[BtnMenu]->repaint(false);
+	for (int i = 0; i < 4; i++)
+	{
+		m_menuIconValid[i] = false;
+		m_menuIcon[i] = KPixmap();
+	}
+
+	if (buttonVisible(BtnMenu))
+		repaintButton(BtnMenu);
 }
 
 
 void BlueCurveClient::desktopChange()
 {
-	if (button[BtnOnAllDesktops]) {
-		button[BtnOnAllDesktops]->turnOn(isOnAllDesktops());
-		button[BtnOnAllDesktops]->repaint(false);
-		button[BtnOnAllDesktops]->setTipText(isOnAllDesktops() ? i18n("Not On All Desktops") : i18n("On All Desktops"));
+	TraceRecorder* t = tracer();
+	if (t)
+		t->desktop( m_traceId, isOnAllDesktops() );
+
+	if (hasButton(BtnOnAllDesktops)) {
+		m_buttons[BtnOnAllDesktops].on = isOnAllDesktops();
+		if (button[BtnOnAllDesktops])
+			button[BtnOnAllDesktops]->turnOn(isOnAllDesktops());
+		repaintButton(BtnOnAllDesktops);
+		setButtonTip(BtnOnAllDesktops, isOnAllDesktops() ? i18n("Not On All Desktops") : i18n("On All Desktops"));
 	}
 }
 
 
 void BlueCurveClient::slotMaximize()
 {
-	if (button[BtnMax])
+	if (hasButton(BtnMax))
 	{
-		switch (button[BtnMax]->last_button)
+		int last = button[BtnMax] ? button[BtnMax]->last_button : m_lastButton;
+		switch (last)
 		{
 			case MidButton:
 				maximize(maximizeMode() ^ MaximizeVertical );
@@ -874,365 +1725,415 @@ void BlueCurveClient::slotMaximize()
 
 void BlueCurveClient::resizeEvent( TQResizeEvent* e)
 {
+	StatTimer timer( StatResize );
 	doShape();
 	calcHiddenButtons();
+
+	// After calcHiddenButtons(), so the trace has the new geometry first
+	TraceRecorder* t = tracer();
+	if (t)
+		t->resize( m_traceId, TQSize( width(), height() ) );
   
 	if (widget()->isVisibleToTLW())
 	{
 		widget()->update(widget()->rect());
 		int dx = 0;
 		int dy = 0;
+		TQSize oldSize = e->oldSize() - TQSize( 2*m_shadow, 2*m_shadow );
 
-		if ( e->oldSize().width() != width() )
-			dx = 32 + TQABS( e->oldSize().width() -  width() );
+		if ( oldSize.width() != width() )
+			dx = 32 + TQABS( oldSize.width() -  width() );
 
-		if ( e->oldSize().height() != height() )
-			dy = 8 + TQABS( e->oldSize().height() -  height() );
+		if ( oldSize.height() != height() )
+			dy = 8 + TQABS( oldSize.height() -  height() );
 
 		if ( dy )
-			widget()->update( 0, height() - dy + 1, width(), dy );
+			widget()->update( toWidget( TQRect( 0, height() - dy + 1, width(), dy ) ) );
 		if ( dx )
 		{
-			widget()->update( width() - dx + 1, 0, dx, height() );
-			widget()->update( TQRect( TQPoint(4,4), titlebar->geometry().bottomLeft() - TQPoint(1,0) ) );
-			widget()->update( TQRect( titlebar->geometry().topRight(), TQPoint(width() - 4,
-				titlebar->geometry().bottom()) ) );
+			widget()->update( toWidget( TQRect( width() - dx + 1, 0, dx, height() ) ) );
+			widget()->update( toWidget( TQRect( TQPoint(4,4), m_titleRect.bottomLeft() - TQPoint(1,0) ) ) );
+			widget()->update( toWidget( TQRect( m_titleRect.topRight(), TQPoint(width() - 4,
+				m_titleRect.bottom()) ) ) );
 			// Titlebar needs no paint event
-			// widget()->repaint(titlebar->geometry(), false);
-			TQApplication::postEvent( widget(), new TQPaintEvent(titlebar->geometry(),FALSE) );
+			// widget()->repaint(m_titleRect, false);
+			TQApplication::postEvent( widget(), new TQPaintEvent(toWidget(m_titleRect),FALSE) );
 		}
 	}
 }
 
 
+// Caption changes are painted right away, but at most once per
+// captionUpdateInterval. Changes arriving in between only mark the
+// caption dirty, the last one is painted when the interval is over.
 void BlueCurveClient::captionChange()
 {
-	widget()->repaint( titlebar->geometry(), false );
+	BLUECURVE_PROBE3( caption_entry, width(), height(), isActive() );
+	TraceRecorder* t = tracer();
+	if (t)
+		t->caption( m_traceId, caption() );
+
+	if (captionUpdateInterval <= 0)
+		widget()->repaint( toWidget( m_titleRect ), false );
+	else if (m_captionTimer.isActive())
+	{
+		// The caption still waiting to be painted is superseded
+		if (m_captionDirty)
+			DecorationStats::count( StatDroppedCaptions );
+		m_captionDirty = true;
+	} else
+	{
+		widget()->repaint( toWidget( m_titleRect ), false );
+		m_captionTimer.start( captionUpdateInterval, true );
+	}
+
+	BLUECURVE_PROBE3( caption_return, width(), height(), isActive() );
 }
 
 
-void BlueCurveClient::paintEvent( TQPaintEvent* )
+void BlueCurveClient::flushCaption()
 {
-	if (!BlueCurve_initialized)
+	if (!m_captionDirty)
 		return;
 
-	TQColorGroup g;
-
-	bool drawLeftDivider = true; 
-	bool drawRightDivider = true; 
-
-	// Obtain widget bounds.
-	TQRect r(widget()->rect());
-	TQPainter p(widget());
+	m_captionDirty = false;
+	widget()->repaint( toWidget( m_titleRect ), false );
+	m_captionTimer.start( captionUpdateInterval, true );
+}
 
-	int x = r.x();
-	int y = r.y();
-	int x2 = x + r.width() - 1;
-	int y2 = y + r.height() - 1;
-	int w  = r.width();
-	int h  = r.height();
-	g = options()->colorGroup(ColorFrame, isActive());
-	// Determine where to place the extended left titlebar
-	//int leftFrameStart = (h > 42) ? y+titleHeight+26: y+titleHeight;
 
-	// Determine where to make the titlebar color transition
-	r = titlebar->geometry();
-	//int rightOffset = r.x()+r.width()+1;
+void BlueCurveClient::paintEvent( TQPaintEvent* e )
+{
+	if (!BlueCurve_initialized)
+		return;
 
-	TQColor c2 = options()->color(ColorFrame, isActive() );
-	// Fill with frame color behind RHS buttons
-	///  p.fillRect( x, y+2, x2, titleHeight+1, c2);
+	StatTimer timer( StatPaint );
+	BLUECURVE_PROBE5( paint_entry, width(), height(),
+		e->region().boundingRect().width(), e->region().boundingRect().height(),
+		isActive() );
+	// The damage in frame coordinates, like everything in a trace
+	TQRegion damage = e->region();
+	damage.translate( -m_shadow, -m_shadow );
 
-	// Create a disposable pixmap buffer for the titlebar
-	// very early before drawing begins so there is no lag
-	// during painting pixels.
-	titleBuffer->resize( w, titleHeight + TOP_GRABBAR_WIDTH );
+	TraceRecorder* t = tracer();
+	if (t)
+		t->expose( m_traceId, damage );
 
+	DecorationState s;
+	decorationState( s );
 
-	// Draw the title bar.
-	r = titlebar->geometry();
+	if (m_sections[SectionTop])
+		updateSections( s, e->region() );
+	else
+	{
+		// The shadow goes first, the frame covers what is under it
+		TQRect frame( m_shadow, m_shadow, width(), height() );
+		const ShadowTiles* shadow = m_shadow ? shadowTiles[s.active ? 1 : 0] : NULL;
+		if (shadow)
+			shadow->paint( widget(), frame, e->region() );
+
+		TQPainter p(widget());
+		p.translate( m_shadow, m_shadow );
+		m_renderer.paint( &p, s, damage );
+		p.end();
+		if (m_argb)
+			cornerAlpha->apply( widget(), frame, e->region(), shadow );
+	}
+	BLUECURVE_PROBE2( paint_return, width(), height() );
+}
 
-	// Obtain titlebar blend colours
-	TQColor c1 = options()->color(ColorTitleBar, isActive() );
 
-	TQPainter p2( titleBuffer, this );
-	TQColor activeTitleColor1(options()->color(ColorTitleBar,      true));
-	TQColor activeTitleColor2(options()->color(ColorTitleBlend,    true));
+// Describes the decoration as it currently is for the renderer
+void BlueCurveClient::decorationState( DecorationState& s )
+{
+	s.size = TQSize( width(), height() );
+	s.caption = caption();
+	s.active = isActive();
+	s.tool = isTool();
+	s.titleHeight = titleHeight;
+	s.titleRect = m_titleRect;
+	s.font = titleFont();
+
+	int left, right, top, bottom;
+	borders( left, right, top, bottom );
+	s.client = TQRect( left - m_shadow, top - m_shadow,
+		width() - left - right + 2*m_shadow, height() - top - bottom + 2*m_shadow );
+	s.readOptions();
+
+	for (int i = 0; i < BlueCurveClient::BtnCount; i++)
+	{
+		if (!hasButton( i ))
+			continue;
+
+		const TitleButton& tb = m_buttons[i];
+		DecorationButton b;
+		b.rect = tb.rect;
+		b.pos = tb.pos;
+		b.hidden = tb.hidden;
+		b.paint = m_windowless;
+		b.glyph = tb.glyph;
+		b.on = tb.on;
+		if (s.active)
+			b.state |= AtlasActive;
+		if (tb.down)
+			b.state |= AtlasDown;
+		if (tb.hover)
+			b.state |= AtlasHover;
+		if (!largeButtons)
+			b.state |= AtlasSmall;
+
+		// Button widgets paint their own icon
+		if (m_windowless && tb.glyph < 0)
+			b.icon = menuIcon( tb.hover, !largeButtons );
+
+		s.buttons.append( b );
+	}
+}
 
-	TQColor inactiveTitleColor1(options()->color(ColorTitleBar,    false));
-	TQColor inactiveTitleColor2(options()->color(ColorTitleBlend,  false));
-	bool highcolor = useGradients && (TQPixmap::defaultDepth() > 8);
 
-	if (highcolor)
+// The titlebar font, cached until the font settings change
+const TQFont& BlueCurveClient::titleFont()
+{
+	if (!m_titleFontValid)
 	{
-		static TQSize oldsize(0,0);
-		TQSize titleBufferSize(w, titleHeight + TOP_GRABBAR_WIDTH);
-		if (oldsize != titleBufferSize)
-		{
-			oldsize = titleBufferSize;
-			if (aUpperGradient)
-			{
-				delete aUpperGradient;
-				aUpperGradient = NULL;
-			}
-			if (iUpperGradient)
-			{
-				delete iUpperGradient;
-				iUpperGradient = NULL;
-			}
-	      
-			// Create the titlebar gradients
-			if (activeTitleColor1 != activeTitleColor2)
-			{
-				aUpperGradient = new KPixmap(oldsize);
-				KPixmapEffect::gradient(*aUpperGradient,
-					activeTitleColor2,
-					activeTitleColor1,
-					KPixmapEffect::VerticalGradient);
-			}
-
-			if (inactiveTitleColor1 != inactiveTitleColor2)
-			{
-				iUpperGradient = new KPixmap(oldsize);
-				KPixmapEffect::gradient(*iUpperGradient,
-					inactiveTitleColor2,
-					inactiveTitleColor1,
-					KPixmapEffect::VerticalGradient);
-			}
-		}
+		m_titleFont = DecorationRenderer::titleFont( isTool() );
+		m_titleFontValid = true;
 	}
-  
-	KPixmap* upperGradient = isActive() ? aUpperGradient : iUpperGradient;
-	// Draw the titlebar gradient
+	return m_titleFont;
+}
 
-	if (upperGradient)
-		p2.drawPixmap(0, TOP_GRABBAR_WIDTH, *upperGradient);
-	else
-		p2.fillRect(0, TOP_GRABBAR_WIDTH, w, titleHeight, c1);
 
-	TQFont fnt = options()->font(true, true);
+/*
+ * In server side background mode the frame is covered by four child
+ * windows, one per side, whose X background pixmaps hold the rendered
+ * frame. The X server repaints them on exposure without a round trip to
+ * us, so we only render when the decoration changes. Paint events of the
+ * decoration widget then update the section pixmaps, and mouse events
+ * pass through the sections to the decoration widget.
+ */
+void BlueCurveClient::createSections()
+{
+	for (int i = 0; i < SectionCount; i++)
+	{
+		m_sections[i] = new TQWidget( widget(), "section",
+			WRepaintNoErase | WResizeNoErase );
+		m_sections[i]->setGeometry( sectionRect( i ) );
+		m_sections[i]->lower();
+		m_sections[i]->show();
+	}
 
-	if ( isTool() )
-		fnt.setPointSize( fnt.pointSize()-2 );  // Shrink font by 2pt
+	// For leaving the windowless buttons
+	m_sections[SectionTop]->installEventFilter( this );
+	m_geometryDirty = true;
+}
 
-	p2.setFont( fnt );
 
-	// Draw the titlebar stipple if active and available
-	if (isActive() && titlePix)
+void BlueCurveClient::deleteSections()
+{
+	for (int i = 0; i < SectionCount; i++)
 	{
-		TQFontMetrics fm(fnt);
-		int captionWidth = fm.width(caption()) + 1;
-		p2.drawTiledPixmap( r.x() + 2 + 2 + captionWidth, TOP_GRABBAR_WIDTH,
-			r.width() - 2 - 4 - captionWidth, 
-			titleHeight+1, *titlePix );
+		delete m_sections[i];
+		m_sections[i] = NULL;
+		m_sectionPix[i] = KPixmap();
 	}
+}
 
-	if (isActive())
-	{
-		p2.setPen( options()->color(ColorTitleBlend, isActive()).dark());
-		p2.drawText(r.x() + 2 + 1, TOP_GRABBAR_WIDTH + 1,
-			r.width() - 2 - 1, r.height(),
-			AlignLeft | AlignVCenter, caption() );
-	}
 
-	p2.setPen( options()->color(ColorFont, isActive()) );
-	p2.drawText(r.x() + 2, TOP_GRABBAR_WIDTH,
-		r.width() - 2, r.height(),
-		AlignLeft | AlignVCenter, caption() );
-
-	// Main Title Bar background area
-	p2.setPen(TQt::white);
-	p2.drawLine(x + 1, y + 1, x2 - 1, y + 1);
-	// This is kind of broken...
-	// We fill in the inner part of the circle here.  This is dependent on BUTTON_DIAM
-	p2.drawLine(x + 1, y + 1, x + 1, y + TOP_GRABBAR_WIDTH + titleHeight);
-	p2.drawLine(x + 2, y + 2, x + 3, y + 2);
-	p2.drawLine(x + 2, y + 2, x + 2, y + 3);
-	p2.drawLine(x + w - 2 , y + 1, x + w - 2, y + TOP_GRABBAR_WIDTH + titleHeight);
-	p2.drawLine(x + w - 3, y + 2, x + w - 3, y + 5);
-	p2.drawLine(x + w - 4, y + 2, x + w - 3, y + 2);
-
-	if (isActive())
+// The sections cover the frame extents, and at least what we paint
+TQRect BlueCurveClient::sectionRect( int i ) const
+{
+	int left, right, top, bottom;
+	borders( left, right, top, bottom );
+	left = TQMAX( left, BORDER_WIDTH );
+	right = TQMAX( right, BORDER_WIDTH );
+	top = TQMAX( top, titleHeight + TOP_GRABBAR_WIDTH + 1 );
+	bottom = TQMAX( bottom, TQMAX( BORDER_WIDTH,
+		TQMAX( bottomLeftPix->height(), bottomRightPix->height() ) ) );
+
+	int w = width();
+	int h = height();
+	switch (i)
 	{
-		TQColor lighterColor (options()->color(ColorTitleBar, true).light (150));
-		p2.setPen (lighterColor);
-		p2.drawLine (r.x(), 2, r.x() + r.width(), 2);
-		int h, s, v;
-		lighterColor.hsv (&h, &s, &v);
-		s /= 2;
-		s = (s > 255) ? 255 : (int) s;
-
-		TQColor satColor(h, s, v, TQColor::Hsv);
-		p2.setPen (satColor);
-		p2.drawLine (r.x(), 1, r.x() + r.width() - 2, 1);
+		case SectionTop:
+			return TQRect( 0, 0, w, top );
+		case SectionLeft:
+			return TQRect( 0, top, left, h - top - bottom );
+		case SectionRight:
+			return TQRect( w - right, top, right, h - top - bottom );
+		default:
+			return TQRect( 0, h - bottom, w, bottom );
 	}
+}
+
 
-	p2.setPen(TQt::white);
-	if (isActive())
+// Renders the damaged part of each section into its pixmap and has the
+// server repaint it. Painting detaches the pixmap from the one the
+// window has, which is a copy on the server.
+void BlueCurveClient::updateSections( const DecorationState& s, const TQRegion& damage )
+{
+	for (int i = 0; i < SectionCount; i++)
 	{
-		for (int i = 0; i < BtnCount; i ++)
+		TQRect r = m_sections[i]->geometry();
+		if (r.isEmpty())
+			continue;
+
+		KPixmap& pix = m_sectionPix[i];
+		TQRegion dirty = damage & TQRegion( r );
+		if (pix.size() != r.size())
 		{
-			if (button[i] == NULL)
-				continue;
-			if (!button[i]->isVisible())
-			{
-				if (button[i]->pos == ButtonRight)
-					drawRightDivider = false;
-				// FIXME: Should be LeftButtonLeft if we had it
-				if (button[i]->pos == LeftButtonRight)
-					drawLeftDivider = false;
-				continue;
-			}
-			TQRect buttonSize = button[i]->geometry ();
-			p2.setPen(TQt::white);
-			p2.drawLine (buttonSize.x() - 1, TOP_GRABBAR_WIDTH,
-			buttonSize.x() - 1, TOP_GRABBAR_WIDTH + titleHeight);
-			if (button[i]->pos == ButtonRight)
-				continue;
-			else if (button[i]->pos == LeftButtonRight)
-				p2.setPen(g.mid().light(120));
-			else
-				p2.setPen(g.dark());
-			p2.drawLine (buttonSize.x() + buttonSize.width(), TOP_GRABBAR_WIDTH - 1,
-				buttonSize.x() + buttonSize.width(), TOP_GRABBAR_WIDTH + titleHeight);
+			pix.resize( r.size() );
+			dirty = TQRegion( r );
 		}
-	}
+		if (dirty.isEmpty())
+			continue;
 
+		TQPainter p( &pix );
+		p.translate( -r.x(), -r.y() );
+		m_renderer.paint( &p, s, dirty );
+		p.end();
 
-	// Top Left Button Area
-	if (drawLeftDivider)
-	{
-		if (isActive ())
-			p2.setPen(options()->color(ColorTitleBar, true).dark (150));
-		else
-			p2.setPen(g.mid());
-		p2.drawLine (r.x() , y + 1, r.x() , y + titleHeight + TOP_GRABBAR_WIDTH);
+		m_sections[i]->setErasePixmap( pix );
+		dirty.translate( -r.x(), -r.y() );
+		m_sections[i]->erase( dirty );
 	}
+}
 
 
+// Where the windowless buttons' tooltips and mouse tracking go
+TQWidget* BlueCurveClient::titleWidget() const
+{
+	return m_sections[SectionTop] ? m_sections[SectionTop] : widget();
+}
 
-	// Top Right Button Area
-	if (drawRightDivider)
-	{
-		if (isActive ())
-			p2.setPen(options()->color(ColorTitleBar, true).dark (150));
-		else
-			p2.setPen(g.mid());
-		p2.drawLine (r.x() + r.width() - 2, y + 1,
-			r.x() + r.width() - 2 , y + titleHeight + TOP_GRABBAR_WIDTH);
-	}
-
-	// Black outer line
-	p2.setPen(TQt::black);
-	p2.drawRect(0,0,w,h);
-	p2.drawArc(x, y, BUTTON_DIAM, BUTTON_DIAM, 90*16, 90*16);
-	p2.drawArc(x + w - BUTTON_DIAM , y, BUTTON_DIAM, BUTTON_DIAM, 0*16, 90*16);
-	p2.end();
-
-	int sideStart = titleHeight + TOP_GRABBAR_WIDTH + 1;
 
-	// Draw the left and right sides
-  
-	// Fill the left side first
-	qDrawShadePanel(&p,
-		// We compensate for the top and bottom parts of the bevel
-		// by drawing 1 pixel below and above the frame part
-		x + 1, y + (sideStart - 1),
-		BORDER_WIDTH - 1, h - (sideStart + 2),
-		g, false, 1, &g.brush(TQColorGroup::Background));
-
-	// Right Side
-	qDrawShadePanel(&p,
-		x2 - (BORDER_WIDTH - 2), y + (sideStart - 1),
-		BORDER_WIDTH - 2, h - (sideStart + 2),
-		g, false, 1, &g.brush(TQColorGroup::Background));
-
-	p.setPen(g.dark());
-	p.drawLine(x2 - (BORDER_WIDTH - 1), sideStart, x2 - (BORDER_WIDTH - 1), h - sideStart);
-
-	// Draw the bottom
-	qDrawShadePanel(&p,
-		x, y2 - (BORDER_WIDTH - 2),
-		w, (BORDER_WIDTH - 2),
-		g, false, 1, &g.brush(TQColorGroup::Background));
-	p.setPen(g.dark());
-	p.drawLine(x, y2 - (BORDER_WIDTH - 1), x2, y2 - (BORDER_WIDTH - 1));
-
-	// Line above the app and below the title bar
-	p.setPen(g.dark());
-	p.drawLine(x, y + titleHeight + TOP_GRABBAR_WIDTH,
-		x2, y + titleHeight + TOP_GRABBAR_WIDTH);
-
-	bitBlt( widget(), 0, 0, titleBuffer );
-
-	// Draw an outer black frame
-	p.setPen(TQt::black);
-	p.drawRect(0,0,w,h);
-
-	// Put on the bottom corners
-	p.drawPixmap(0, h - bottomLeftPix->height(),
-		isActive() ? *abottomLeftPix : *bottomLeftPix);
-	p.drawPixmap(w - bottomRightPix->width(), h - bottomRightPix->height(), 
-		isActive() ? *abottomRightPix : *bottomRightPix);
-	p.end();
+// The recorder if events are being recorded. A new recording gets our
+// geometry before anything else.
+TraceRecorder* BlueCurveClient::tracer()
+{
+	if (!traceRecorder)
+		return NULL;
+	if (m_traceGeneration != traceRecorder->generation())
+		traceGeometry();
+	return traceRecorder;
 }
 
 
-void BlueCurveClient::shadeChange()
-{ ; }
+void BlueCurveClient::traceGeometry()
+{
+	m_traceGeneration = traceRecorder->generation();
+
+	DecorationState s;
+	decorationState( s );
+	traceRecorder->geometry( m_traceId, s );
+}
 
 
-void BlueCurveClient::doShape()
+// The number of button i in the trace, its index in decorationState()
+int BlueCurveClient::traceButton( int i ) const
 {
-	// Obtain widget bounds.
-	TQRect r(widget()->rect());
-	int x = 0;
-	int y = 0;
-	//int x2 = width() - 1;
-	//int y2 = height() - 1;
-	int w  = width();
-	int h  = height();
+	int n = 0;
+	for (int j = 0; j < i; j++)
+		if (hasButton( j ))
+			n++;
+	return n;
+}
 
-	int rad = BUTTON_DIAM / 2;
-	int dm = BUTTON_DIAM;
 
-	TQBitmap mask(w+1, h+1, true);
+void BlueCurveClient::traceButtonEvent( const BlueCurveButton* b, int event, int mouseButton )
+{
+	TraceRecorder* t = tracer();
+	if (!t)
+		return;
 
-	TQPainter p(&mask);
+	// No button when the mouse left one
+	int n = -1;
+	for (int i = 0; b && i < BlueCurveClient::BtnCount; i++)
+		if (button[i] == b)
+			n = traceButton( i );
 
-	p.fillRect(x, y, w+1, h+1, TQt::color1);
+	if (event == TraceHover)
+		t->hover( m_traceId, n );
+	else if (n < 0)
+		return;
+	else if (event == TracePress)
+		t->press( m_traceId, n, mouseButton );
+	else if (event == TraceRelease)
+		t->release( m_traceId, n, mouseButton );
+	else if (event == TraceButtonPaint)
+		t->buttonPaint( m_traceId, n );
+}
 
-	p.eraseRect(x, y, rad, rad);
-	p.eraseRect(w-rad+1, 0, rad, rad);
 
-	p.eraseRect(x, h-BOTTOM_CORNER, BOTTOM_CORNER, BOTTOM_CORNER);
-	p.eraseRect(w-BOTTOM_CORNER, h-BOTTOM_CORNER, BOTTOM_CORNER, BOTTOM_CORNER);
+void BlueCurveClient::shadeChange()
+{ ; }
 
-	p.setPen(TQt::color1);
-	p.setBrush(TQt::color1);
 
-	p.drawPie(x, y, dm, dm, 90*16, 90*16);
-	p.drawArc(x, y, dm, dm, 90*16, 90*16);
+// The shape only differs from a rectangle in the four corners. Paint it
+// once for a window just large enough to hold all of them, and keep what
+// was cut away in each corner, relative to that corner of the window.
+void BlueCurveHandler::createShapeCorners()
+{
+	int cw = TQMAX( BUTTON_DIAM, TQMAX( bottomLeftPix->width(), bottomRightPix->width() ) );
+	int ch = TQMAX( BUTTON_DIAM, TQMAX( bottomLeftPix->height(), bottomRightPix->height() ) );
+	int w = 2*cw + 2;
+	int h = 2*ch + 2;
+
+	TQRegion cutout = TQRegion( 0, 0, w+1, h+1 )
+		- TQRegion( DecorationRenderer::shapeBitmap( w, h ) );
+
+	shapeCorners = new TQRegion[4];
+	shapeCorners[0] = cutout & TQRegion( 0, 0, cw+1, ch+1 );
+	shapeCorners[1] = cutout & TQRegion( cw+1, 0, w-cw, ch+1 );
+	shapeCorners[1].translate( -w, 0 );
+	shapeCorners[2] = cutout & TQRegion( 0, ch+1, cw+1, h-ch );
+	shapeCorners[2].translate( 0, -h );
+	shapeCorners[3] = cutout & TQRegion( cw+1, ch+1, w-cw, h-ch );
+	shapeCorners[3].translate( -w, -h );
+
+	shapeCornersMinSize = TQSize( w, h );
+}
 
-	p.drawPie(w-dm, 0, dm, dm, 0*16, 90*16);
-	p.drawArc(w-dm, 0, dm, dm, 0*16, 90*16);
 
-	p.drawPixmap(x, h - bottomLeftPix->height(), *bottomLeftPix->mask());
+// The shadows reach under the corners as far as their alpha masks. An
+// inactive window casts a lighter shadow.
+void BlueCurveHandler::createShadows()
+{
+	if (!showShadows)
+		return;
 
-	p.drawPixmap(w-bottomRightPix->width(), h - bottomRightPix->height(), 
-		*bottomRightPix->mask());
-	p.fillRect(x+BOTTOM_CORNER, h - bottomLeftPix->height(),
-		bottomLeftPix->width()-BOTTOM_CORNER,
-		bottomLeftPix->height()-BOTTOM_CORNER,
-		TQt::color1);
+	for (int active = 0; active < 2; active++)
+	{
+		int opacity = active ? shadowOpacity : shadowOpacity * 2 / 3;
+		shadowTiles[active] = new ShadowTiles( shadowSize, opacity,
+			cornerAlpha->tileSize() );
+		if (!shadowTiles[active]->isValid())
+		{
+			delete shadowTiles[active];
+			shadowTiles[active] = NULL;
+		}
+	}
+}
 
-	p.fillRect(w-bottomRightPix->width(), h - bottomRightPix->height(), 
-		bottomRightPix->width()-BOTTOM_CORNER,
-		bottomRightPix->height()-BOTTOM_CORNER,
-		TQt::color1);
 
-	p.end();
-	setMask(mask);
+void BlueCurveClient::doShape()
+{
+	StatTimer timer( StatShape );
+	BLUECURVE_PROBE2( shape_entry, width(), height() );
+	if (m_argb && width() >= cornerAlpha->minSize().width()
+		&& height() >= cornerAlpha->minSize().height())
+	{
+		// The corners are transparent instead, see paintEvent()
+		if (m_shaped)
+			clearMask();
+		m_shaped = false;
+	} else
+	{
+		TQRegion shape = DecorationRenderer::shape( width(), height() );
+		shape.translate( m_shadow, m_shadow );
+		setMask( shape );
+		m_shaped = true;
+	}
+	BLUECURVE_PROBE2( shape_return, width(), height() );
 }
 
 
@@ -1246,17 +2147,24 @@ void BlueCurveClient::showEvent(TQShowEvent *)
 
 void BlueCurveClient::mouseDoubleClickEvent( TQMouseEvent * e )
 {
-	if ( titlebar->geometry().contains( e->pos() ) )
+	if ( m_titleRect.contains( toFrame( e->pos() ) ) )
 		titlebarDblClickOperation();
 }
 
 
 void BlueCurveClient::maximizeChange()
 {
-	if (button[BtnMax]) {
-		button[BtnMax]->setBitmap((maximizeMode()==MaximizeFull) ? minmax_bits : maximize_bits);
-		button[BtnMax]->setTipText((maximizeMode()==MaximizeFull) ? i18n("Restore") : i18n("Maximize"));
-	}
+	TraceRecorder* t = tracer();
+	if (t)
+		t->maximize( m_traceId, maximizeMode() );
+
+	const unsigned char* bitmap = (maximizeMode()==MaximizeFull) ? minmax_bits : maximize_bits;
+	m_buttons[BtnMax].glyph = glyphForBitmap(bitmap);
+	if (button[BtnMax])
+		button[BtnMax]->setBitmap(bitmap);
+	else if (m_buttons[BtnMax].used)
+		repaintButton(BtnMax);
+	setButtonTip(BtnMax, (maximizeMode()==MaximizeFull) ? i18n("Restore") : i18n("Maximize"));
 }
 
 
@@ -1265,11 +2173,35 @@ void BlueCurveClient::borders( int& left, int& right, int& top, int& bottom ) co
 	left = right = borderWidth;
 	top = titleHeight + 4;
 	bottom = (showGrabBar && isResizable()) ? grabBorderWidth : borderWidth;
+
+	// The shadow is part of the decoration widget
+	left += m_shadow;
+	right += m_shadow;
+	top += m_shadow;
+	bottom += m_shadow;
+}
+
+
+TQRect BlueCurveClient::toWidget( const TQRect& r ) const
+{
+	TQRect w = r;
+	w.moveBy( m_shadow, m_shadow );
+	return w;
+}
+
+
+TQPoint BlueCurveClient::toFrame( const TQPoint& p ) const
+{
+	return p - TQPoint( m_shadow, m_shadow );
 }
 
 
 void BlueCurveClient::activeChange()
 {
+	TraceRecorder* t = tracer();
+	if (t)
+		t->active( m_traceId, isActive() );
+
 	for(int i=BlueCurveClient::BtnHelp; i < BlueCurveClient::BtnCount; i++)
 		if(button[i])
 			button[i]->repaint(false);
@@ -1292,11 +2224,12 @@ TQSize BlueCurveClient::minimumSize() const
 // The hiding button while shrinking, show button while expanding magic
 void BlueCurveClient::calcHiddenButtons()
 {
+	StatTimer timer( StatHiddenButtons );
+
 	// Hide buttons in this order:
 	// Sticky, Help, Maximize, Minimize, Close, Menu.
-	BlueCurveButton* btnArray[] = { button[BtnOnAllDesktops], button[BtnHelp],
-		button[BtnMax], button[BtnIconify], button[BtnClose],
-		button[BtnMenu] };
+	static const int btnArray[] = { BtnOnAllDesktops, BtnHelp,
+		BtnMax, BtnIconify, BtnClose, BtnMenu };
 
 	int minwidth  = 160; // Start hiding at this width
 	int btn_width = 16;
@@ -1315,35 +2248,49 @@ void BlueCurveClient::calcHiddenButtons()
 	if (count > 6)
 		count = 6;
 
-	// Hide the required buttons...
-	for(i = 0; i < count; i++)
-	{
-		if ( btnArray[i] && btnArray[i]->isVisible() )
-			btnArray[i]->hide();
-    }
+	// Hide the required buttons and show the rest
+	for(i = 0; i < 6; i++)
+		setButtonHidden( btnArray[i], i < count );
 
-	// Show the rest of the buttons...
-	for(i = count; i < 6; i++)
-	{
-		if (btnArray[i] && (!btnArray[i]->isVisible()) )
-			btnArray[i]->show();
-	}
+	updateGeometry();
 }
 
 
 KDecoration::Position BlueCurveClient::mousePosition( const TQPoint& p ) const
 {
 	Position m = PositionCenter;
+	TQPoint fp = toFrame( p );
+
+	// KDecoration clamps the top border to 4 pixels of the widget, which
+	// would leave the top shadow and frame edge moving the window. So the
+	// shadow and the top edge are sorted out here, in frame coordinates.
+	if (m_shadow && (fp.y() < 4 || fp.y() >= height()
+		|| fp.x() < 0 || fp.x() >= width()))
+	{
+		const int range = 16;
+		bool left = fp.x() < range;
+		bool right = fp.x() >= width() - range;
+		bool top = fp.y() < range;
+		bool bottom = fp.y() >= height() - range;
+
+		if (fp.y() < 4)
+			return left ? PositionTopLeft : right ? PositionTopRight : PositionTop;
+		if (fp.y() >= height())
+			return left ? PositionBottomLeft : right ? PositionBottomRight : PositionBottom;
+		if (fp.x() < 0)
+			return top ? PositionTopLeft : bottom ? PositionBottomLeft : PositionLeft;
+		return top ? PositionTopRight : bottom ? PositionBottomRight : PositionRight;
+	}
 
 	// Modify the mouse position if we are using a grab bar.
 	if (showGrabBar && (!isTool()) )
-		if (p.y() < (height() - 8))
+		if (fp.y() < (height() - 8))
 			m = KDecoration::mousePosition(p);
 		else
 		{
-			if (p.x() >= (width() - 20))
+			if (fp.x() >= (width() - 20))
 				m = PositionBottomRight;
-			else if (p.x() <= 20)
+			else if (fp.x() <= 20)
 				m = PositionBottomLeft;
 			else
 				m = PositionBottom;
@@ -1370,14 +2317,22 @@ void BlueCurveClient::menuButtonPressed()
 		return;
 	}
 
-	TQPoint menupoint ( button[BtnMenu]->rect().bottomLeft().x()-1,
-					button[BtnMenu]->rect().bottomLeft().y()+2 );
+	TQRect r = toWidget( buttonGeometry( BtnMenu ) );
+	TQPoint menupoint ( r.left()-1, r.bottom()+2 );
 	KDecorationFactory* f = factory();
-	showWindowMenu( button[BtnMenu]->mapToGlobal( menupoint ));
+	showWindowMenu( widget()->mapToGlobal( menupoint ));
 	if( !f->exists( this )) // 'this' was destroyed
 		return;
 
-	button[BtnMenu]->setDown(false);
+	if (button[BtnMenu])
+		button[BtnMenu]->setDown(false);
+	else
+	{
+		// The menu took the release event
+		m_pressedButton = -1;
+		m_buttons[BtnMenu].down = false;
+		repaintButton(BtnMenu);
+	}
 }
 
 
@@ -1390,6 +2345,15 @@ void BlueCurveClient::menuButtonReleased()
 
 bool BlueCurveClient::eventFilter( TQObject* o, TQEvent* e )
 {
+	// Only the titlebar section has a filter, the mouse events go on to
+	// the decoration widget
+	if ( o == m_sections[SectionTop] )
+	{
+		if (m_windowless && e->type() == TQEvent::Leave)
+			setHoverButton( -1 );
+		return false;
+	}
+
 	if ( o != widget() )
 		return false;
 
@@ -1402,11 +2366,24 @@ bool BlueCurveClient::eventFilter( TQObject* o, TQEvent* e )
 			paintEvent(static_cast< TQPaintEvent* >( e ) );
 			return true;
 		case TQEvent::MouseButtonDblClick:
+			// Windowless buttons see the second click as a press
+			if (m_windowless && buttonPress(static_cast< TQMouseEvent* >( e ) ))
+				return true;
 			mouseDoubleClickEvent(static_cast< TQMouseEvent* >( e ) );
 			return true;
 		case TQEvent::MouseButtonPress:
+			if (m_windowless && buttonPress(static_cast< TQMouseEvent* >( e ) ))
+				return true;
 			processMousePressEvent(static_cast< TQMouseEvent* >( e ) );
 			return true;
+		case TQEvent::MouseButtonRelease:
+			return m_windowless && buttonRelease(static_cast< TQMouseEvent* >( e ) );
+		case TQEvent::MouseMove:
+			return m_windowless && buttonMove(static_cast< TQMouseEvent* >( e ) );
+		case TQEvent::Leave:
+			if (m_windowless)
+				setHoverButton( -1 );
+			return false;
 		case TQEvent::Show:
 			showEvent(static_cast<TQShowEvent *>(e));
 			return true;
@@ -18,22 +18,42 @@
 #include <tqbutton.h>
 #include <tqbitmap.h>
 #include <tqdatetime.h>
+#include <tqtimer.h>
+#include <tqvaluelist.h>
 #include <kpixmap.h>
 #include <kdecoration.h>
 #include <kdecorationfactory.h>
 
+#include "bluecurverenderer.h"
 
-class TQSpacerItem;
-class TQBoxLayout;
-class TQGridLayout;
-class TQHBoxLayout;
+
+class TQLabel;
+class TDESelectionWatcher;
 
 namespace BlueCurve {
 
 class BlueCurveClient;
+class TraceRecorder;
+
+// Change bits for our own configuration, passed along with the
+// KDecorationDefines Setting* bits to BlueCurveClient::reset()
+enum { SettingBlueCurveTitleSize = 1 << 16, SettingBlueCurveGrabBar = 1 << 17,
+	SettingBlueCurveStipple = 1 << 18, SettingBlueCurveGradients = 1 << 19,
+	SettingBlueCurveButtonMode = 1 << 20, SettingBlueCurveBackground = 1 << 21,
+	SettingBlueCurveCorners = 1 << 22, SettingBlueCurveShadow = 1 << 23 };
+
+// Every glyph a titlebar button can show
+enum ButtonGlyph { GlyphMenu = 0, GlyphHelp, GlyphIconify, GlyphMaximize,
+	GlyphRestore, GlyphClose, GlyphPinUp, GlyphPinDown, GlyphCount };
+
+// Button atlas state bits, combined into an index below AtlasStateCount
+enum ButtonAtlasState { AtlasActive = 1, AtlasDown = 2, AtlasHover = 4,
+	AtlasSmall = 8, AtlasStateCount = 16 };
 
-class BlueCurveHandler: public KDecorationFactory
+class BlueCurveHandler: public TQObject, public KDecorationFactory
 {
+	TQ_OBJECT
+
 	public:
 		BlueCurveHandler();
 		~BlueCurveHandler();
@@ -41,15 +61,38 @@ class BlueCurveHandler: public KDecorationFactory
 		bool reset(unsigned long changed);
 		//virtual TQValueList< BorderSize > borderSizes() const;
 
+		static void borderWidths( BorderSize size, int& border, int& grabBorder );
+
+	private slots:
+		void compositingChanged();
+
 	private:
-		void readConfig();
-		void createPixmaps();
-		void freePixmaps();
+		// Groups of cached pixmaps which are rebuilt together
+		enum Asset { AssetStipple = 1, AssetGradients = 2, AssetPins = 4,
+			AssetButtons = 8, AssetCorners = 16, AssetShadows = 32, AssetAll = 63 };
+
+		unsigned long readConfig();
+		unsigned long affectedAssets( unsigned long changed );
+		void createPixmaps( unsigned long assets );
+		void freePixmaps( unsigned long assets );
+		void createStipple();
+		KPixmap* createStippleTile(int titleHeight);
+		void createPins();
+		void createButtonBackgrounds();
+		void createCorners();
 		void drawButtonBackground(KPixmap *pix, 
 			const TQColorGroup &g,
 			bool sunken,
 			bool active);
 		void recolor( TQImage &img, const TQColor& color );
+		void createButtonAtlas();
+		void createShapeCorners();
+		void createShadows();
+		void createButtonShapes();
+		void renderButtonState( KPixmap *pix, int glyph, int state );
+
+		// Owner of the composition manager selection
+		TDESelectionWatcher* m_compositingWatcher;
 };
 
 enum ButtonPos { ButtonLeft = 0, ButtonMid, ButtonRight, LeftButtonRight };
@@ -82,11 +125,13 @@ class BlueCurveButton : public TQButton, public KDecorationDefines
 		void drawButton(TQPainter *p);
 		void drawButtonLabel(TQPainter*) {;}
 
-		TQBitmap* deco;
+		int glyph;
 		bool large;
 		bool isLeft;
 		bool isOnAllDesktops;
 		bool isMouseOver;
+		int shapedPos;
+		TQSize shapedSize;
 		BlueCurveClient* client;
 
 		int realizeButtons;
@@ -99,9 +144,14 @@ class BlueCurveClient : public KDecoration
 
 	public:
 		BlueCurveClient( KDecorationBridge* bridge, KDecorationFactory* factory );
-		~BlueCurveClient() {;}
+		~BlueCurveClient();
 
 		virtual void init();
+		virtual void reset( unsigned long changed );
+		const KPixmap& menuIcon( bool hover, bool small );
+
+		// Records a TraceEvent of a button widget
+		void traceButtonEvent( const BlueCurveButton* b, int event, int mouseButton = 0 );
 
 	protected:
 		virtual void resizeEvent( TQResizeEvent* );
@@ -110,6 +160,14 @@ class BlueCurveClient : public KDecoration
 		virtual void mouseDoubleClickEvent( TQMouseEvent * );
 
 		virtual void doShape();
+
+		// The size of the frame, without the shadow around it. Everything
+		// but painting and events works in frame coordinates.
+		int width() const { return KDecoration::width() - 2*m_shadow; }
+		int height() const { return KDecoration::height() - 2*m_shadow; }
+		TQRect toWidget( const TQRect& r ) const;
+		TQPoint toFrame( const TQPoint& p ) const;
+
 		virtual void borders( int&, int&, int&, int& ) const;
 		virtual void resize(const TQSize&);
 		virtual void captionChange();
@@ -127,24 +185,124 @@ class BlueCurveClient : public KDecoration
 		void slotMaximize();
 		void menuButtonPressed();
 		void menuButtonReleased();
+		void flushCaption();
 
 	private:
 		bool eventFilter( TQObject* o, TQEvent* e );
 		void calcHiddenButtons();
 		void addClientButtons( const TQString& s, bool isLeft=true );
+		void addButton( int i, const char* name, int pos, bool toggle,
+			const unsigned char* bitmap, const TQString& tip,
+			int realizeBtns=LeftButton );
+		void createButtons();
+		void updateGeometry();
+
+		// Work on either kind of button, see m_windowless
+		bool hasButton( int i ) const;
+		bool buttonVisible( int i ) const;
+		int buttonPos( int i ) const;
+		TQRect buttonGeometry( int i ) const;
+		void setButtonHidden( int i, bool hide );
+		void setButtonTip( int i, const TQString& tip );
+		void repaintButton( int i );
+
+		// Windowless buttons only
+		int buttonAt( const TQPoint& p ) const;
+		bool buttonPress( TQMouseEvent* e );
+		bool buttonMove( TQMouseEvent* e );
+		bool buttonRelease( TQMouseEvent* e );
+		void buttonClicked( int i );
+		void setHoverButton( int i );
+		void updateButtonTips();
+
+		void decorationState( DecorationState& s );
+		const TQFont& titleFont();
+
+		// Server side background mode only
+		void createSections();
+		void deleteSections();
+		TQRect sectionRect( int i ) const;
+		void updateSections( const DecorationState& s, const TQRegion& damage );
+		TQWidget* titleWidget() const;
+
+		// Event recording, see bluecurvetrace.h
+		TraceRecorder* tracer();
+		void traceGeometry();
+		int traceButton( int i ) const;
 
 		enum Buttons{ BtnHelp=0, BtnMax, BtnIconify, BtnClose,
 			BtnMenu, BtnOnAllDesktops, BtnCount };
 		BlueCurveButton* button[ BlueCurveClient::BtnCount ];
 
-		int           lastButtonWidth;
+		// Geometry and state of a titlebar button. With windowless buttons
+		// there is no widget, the button is painted into the title buffer.
+		struct TitleButton
+		{
+			bool          used;
+			TQRect        rect;
+			int           glyph;
+			int           pos;
+			int           realizeButtons;
+			bool          on;
+			bool          down;
+			bool          hover;
+			bool          hidden;
+			TQString      tip;
+		};
+
+		bool          m_windowless;
+		TitleButton   m_buttons[ BlueCurveClient::BtnCount ];
+		int           m_hoverButton;
+		int           m_pressedButton;
+		int           m_lastButton;
+
+		// Titlebar contents from left to right: a button index, TitleSlot
+		// for the caption area or a negative spacing in pixels
+		enum { TitleSlot = BtnCount };
+		TQValueList<int> m_titleItems;
+
+		// Caption area, recomputed when the width or the buttons change
+		TQRect        m_titleRect;
+		int           m_geometryWidth;
+		bool          m_geometryDirty;
+
 		int           titleHeight;
 		bool          largeButtons;
-		TQGridLayout*  g;
-		TQHBoxLayout*  hb;
-		TQSpacerItem*  titlebar;
-		TQSpacerItem*  spacer;
+		TQLabel*       m_label;
 		bool          m_closing;
+
+		// Processed application icon, indexed by hover | small << 1
+		KPixmap       m_menuIcon[4];
+		bool          m_menuIconValid[4];
+
+		// Titlebar font, and the renderer holding the caption pixmap
+		TQFont        m_titleFont;
+		bool          m_titleFontValid;
+		DecorationRenderer m_renderer;
+
+		// Transparent corners instead of a window shape, see CornerAlpha,
+		// and whether a shape is set
+		bool          m_argb;
+		bool          m_shaped;
+
+		// Width of the shadow around the frame, 0 without one
+		int           m_shadow;
+
+		// Frame sections with the rendered frame as their X background
+		// pixmap, NULL unless in server side background mode
+		enum { SectionTop = 0, SectionLeft, SectionRight, SectionBottom,
+			SectionCount };
+		TQWidget*     m_sections[ SectionCount ];
+		KPixmap       m_sectionPix[ SectionCount ];
+
+		// Caption repaint coalescing
+		TQTimer       m_captionTimer;
+		bool          m_captionDirty;
+
+		// Our id in event traces, and the recorder we last described
+		// our geometry to
+		unsigned int  m_traceId;
+		unsigned int  m_traceGeneration;
 };
 
 }
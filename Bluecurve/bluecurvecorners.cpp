@@ -0,0 +1,199 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Antialiased frame corners for decorations with an alpha channel.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "bluecurvecorners.h"
+#include "bluecurveshadow.h"
+
+#include <tqwidget.h>
+
+#include <X11/Xlib.h>
+#ifdef HAVE_XRENDER
+#include <X11/extensions/Xrender.h>
+#endif
+
+namespace BlueCurve
+{
+
+// Window shape corner cutouts, owned by BlueCurveHandler
+extern TQRegion* shapeCorners;
+extern TQSize shapeCornersMinSize;
+
+
+/*
+ * The masks are cut from the frame the shape corners were made for. A
+ * pixel inside the shape keeps the part of its 3x3 neighbourhood that is
+ * inside too, pixels outside are transparent. That feathers the rounded
+ * and bevelled edges towards the inside and leaves the straight ones.
+ */
+CornerAlpha::CornerAlpha()
+	: m_scratch( 0 ), m_scratchPict( 0 ), m_valid( false )
+{
+	for ( int i = 0; i < 4; i++ )
+		m_masks[i] = 0;
+
+	m_minSize = shapeCornersMinSize;
+	m_tileSize = TQSize( m_minSize.width() / 2, m_minSize.height() / 2 );
+
+#ifdef HAVE_XRENDER
+	Display* dpy = tqt_xdisplay();
+	int event, error;
+	if ( !XRenderQueryExtension( dpy, &event, &error ) )
+		return;
+
+	XRenderPictFormat* a8 = XRenderFindStandardFormat( dpy, PictStandardA8 );
+	XRenderPictFormat* argb = XRenderFindStandardFormat( dpy, PictStandardARGB32 );
+	if ( !a8 || !argb )
+		return;
+
+	// The cutouts of the reference frame, each relative to its corner
+	int w = m_minSize.width();
+	int h = m_minSize.height();
+	TQRegion cutout = shapeCorners[0];
+	TQRegion corner = shapeCorners[1];
+	corner.translate( w, 0 );
+	cutout += corner;
+	corner = shapeCorners[2];
+	corner.translate( 0, h );
+	cutout += corner;
+	corner = shapeCorners[3];
+	corner.translate( w, h );
+	cutout += corner;
+
+	int tw = m_tileSize.width();
+	int th = m_tileSize.height();
+	Window root = DefaultRootWindow( dpy );
+	XRenderColor color = { 0, 0, 0, 0xffff };
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		Pixmap pix = XCreatePixmap( dpy, root, tw, th, 8 );
+		m_masks[i] = XRenderCreatePicture( dpy, pix, a8, 0, NULL );
+		XFreePixmap( dpy, pix );
+
+		color.alpha = 0xffff;
+		XRenderFillRectangle( dpy, PictOpSrc, m_masks[i], &color, 0, 0, tw, th );
+
+		int x0 = (i & 1) ? tw : 0;
+		int y0 = (i & 2) ? th : 0;
+		for ( int y = 0; y < th; y++ )
+			for ( int x = 0; x < tw; x++ )
+			{
+				int a = coverage( cutout, x0 + x, y0 + y );
+				if ( a == 255 )
+					continue;
+				color.alpha = a * 257;
+				XRenderFillRectangle( dpy, PictOpSrc, m_masks[i], &color, x, y, 1, 1 );
+			}
+	}
+
+	m_scratch = XCreatePixmap( dpy, root, tw, th, 32 );
+	m_scratchPict = XRenderCreatePicture( dpy, m_scratch, argb, 0, NULL );
+	m_valid = true;
+#endif
+}
+
+
+CornerAlpha::~CornerAlpha()
+{
+#ifdef HAVE_XRENDER
+	Display* dpy = tqt_xdisplay();
+	for ( int i = 0; i < 4; i++ )
+		if ( m_masks[i] )
+			XRenderFreePicture( dpy, m_masks[i] );
+	if ( m_scratchPict )
+		XRenderFreePicture( dpy, m_scratchPict );
+	if ( m_scratch )
+		XFreePixmap( dpy, m_scratch );
+#endif
+}
+
+
+// The alpha of pixel x, y of the reference frame, 0 to 255
+int CornerAlpha::coverage( const TQRegion& cutout, int x, int y ) const
+{
+	if ( cutout.contains( TQPoint( x, y ) ) )
+		return 0;
+
+	// Neighbours beyond the frame count as inside
+	int inside = 0;
+	for ( int dy = -1; dy <= 1; dy++ )
+		for ( int dx = -1; dx <= 1; dx++ )
+		{
+			int nx = x + dx;
+			int ny = y + dy;
+			if ( nx < 0 || ny < 0 || nx >= m_minSize.width() || ny >= m_minSize.height()
+				|| !cutout.contains( TQPoint( nx, ny ) ) )
+				inside++;
+		}
+	return inside * 255 / 9;
+}
+
+
+bool CornerAlpha::usable( const TQWidget* w ) const
+{
+	return m_valid && w->x11Depth() == 32;
+}
+
+
+TQRect CornerAlpha::cornerRect( int corner, const TQRect& frame ) const
+{
+	int x = (corner & 1) ? frame.right() + 1 - m_tileSize.width() : frame.left();
+	int y = (corner & 2) ? frame.bottom() + 1 - m_tileSize.height() : frame.top();
+	return TQRect( TQPoint( x, y ), m_tileSize );
+}
+
+
+// Each damaged part of a corner goes to the scratch pixmap and back
+// through the mask. Only what was just painted may be masked, pixels
+// which already went through it would be darkened twice.
+void CornerAlpha::apply( TQWidget* w, const TQRect& frame, const TQRegion& damage,
+		const ShadowTiles* shadow )
+{
+#ifdef HAVE_XRENDER
+	if ( !m_valid || frame.width() < m_minSize.width()
+		|| frame.height() < m_minSize.height() )
+		return;
+
+	Display* dpy = w->x11Display();
+	XRenderPictFormat* format = XRenderFindVisualFormat( dpy, (Visual*) w->x11Visual() );
+	if ( !format )
+		return;
+	Picture target = XRenderCreatePicture( dpy, w->winId(), format, 0, NULL );
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		TQRect corner = cornerRect( i, frame );
+		TQMemArray<TQRect> rects = (damage & TQRegion( corner )).rects();
+		for ( unsigned int j = 0; j < rects.size(); j++ )
+		{
+			const TQRect& r = rects[j];
+			int tx = r.x() - corner.x();
+			int ty = r.y() - corner.y();
+			XRenderComposite( dpy, PictOpSrc, target, None, m_scratchPict,
+				r.x(), r.y(), 0, 0, tx, ty, r.width(), r.height() );
+			if ( shadow )
+				shadow->paint( target, frame, TQRegion( r ) );
+			XRenderComposite( dpy, shadow ? PictOpOver : PictOpSrc, m_scratchPict,
+				m_masks[i], target, tx, ty, tx, ty, r.x(), r.y(), r.width(), r.height() );
+		}
+	}
+
+	XRenderFreePicture( dpy, target );
+#else
+	Q_UNUSED( w );
+	Q_UNUSED( frame );
+	Q_UNUSED( damage );
+	Q_UNUSED( shadow );
+#endif
+}
+
+}
+
+// vim: ts=4
@@ -0,0 +1,65 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Antialiased frame corners for decorations with an alpha channel.
+ */
+
+#ifndef _BLUECURVE_CORNERS_H
+#define _BLUECURVE_CORNERS_H
+
+#include <tqregion.h>
+#include <tqsize.h>
+
+class TQWidget;
+
+namespace BlueCurve {
+
+class ShadowTiles;
+
+/*
+ * Under a composition manager a frame with a 32 bit visual doesn't need a
+ * window shape, its corners can be made transparent instead. How much of
+ * each corner pixel lies inside the shape is computed once, from the same
+ * cutouts the shape is made of, and kept on the server as one alpha mask
+ * per corner. After a paint, the repainted parts of the corners are read
+ * back and written again through their masks, so nothing has to be
+ * uploaded while the window is resized.
+ *
+ * The masks only fit frames of at least minSize(), like the shape
+ * corners. Smaller frames keep their shape. With a shadow, the corners
+ * are written over it instead of replacing what is behind them.
+ */
+class CornerAlpha
+{
+	public:
+		CornerAlpha();
+		~CornerAlpha();
+
+		// Whether the corners of w can be made transparent, once a
+		// composition manager runs
+		bool usable( const TQWidget* w ) const;
+
+		const TQSize& minSize() const { return m_minSize; }
+		const TQSize& tileSize() const { return m_tileSize; }
+
+		// Applies the masks to the parts of the corners of the frame at
+		// frame in w that are in damage
+		void apply( TQWidget* w, const TQRect& frame, const TQRegion& damage,
+			const ShadowTiles* shadow = NULL );
+
+	private:
+		TQRect cornerRect( int corner, const TQRect& frame ) const;
+		int coverage( const TQRegion& cutout, int x, int y ) const;
+
+		TQSize m_minSize;
+		TQSize m_tileSize;
+		TQt::HANDLE m_masks[4];      // A8 pictures, in the order of shapeCorners
+		TQt::HANDLE m_scratch;       // ARGB32 pixmap of one tile
+		TQt::HANDLE m_scratchPict;
+		bool m_valid;
+};
+
+}
+
+#endif
+// vim: ts=4
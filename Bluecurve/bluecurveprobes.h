@@ -0,0 +1,57 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Static tracepoints, built with WITH_SDT_PROBES. They are nops until
+ *	a tracer attaches, for example:
+ *
+ *		bpftrace -e 'usdt:/usr/lib/trinity/twin_bluecurve.so:bluecurve:paint_entry
+ *			{ @[arg4] = hist(arg2 * arg3); }'
+ *
+ *	paint_entry      width, height, damage width, damage height, active
+ *	paint_return     width, height
+ *	shape_entry      width, height
+ *	shape_return     width, height
+ *	reset_entry      changed Setting* bits
+ *	reset_return     changed Setting* bits
+ *	pixmaps_entry    Asset* bits
+ *	pixmaps_return   Asset* bits
+ *	button_entry     glyph, ButtonAtlasState bits
+ *	button_return    glyph, ButtonAtlasState bits
+ *	caption_entry    width, height, active
+ *	caption_return   width, height, active
+ *
+ *	The damage is the bounding rectangle of the painted region. Buttons
+ *	fire for button widgets and for windowless buttons alike.
+ */
+
+#ifndef _BLUECURVE_PROBES_H
+#define _BLUECURVE_PROBES_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define BLUECURVE_PROBE1( name, a ) \
+	DTRACE_PROBE1( bluecurve, name, a )
+#define BLUECURVE_PROBE2( name, a, b ) \
+	DTRACE_PROBE2( bluecurve, name, a, b )
+#define BLUECURVE_PROBE3( name, a, b, c ) \
+	DTRACE_PROBE3( bluecurve, name, a, b, c )
+#define BLUECURVE_PROBE5( name, a, b, c, d, e ) \
+	DTRACE_PROBE5( bluecurve, name, a, b, c, d, e )
+
+#else
+
+#define BLUECURVE_PROBE1( name, a )
+#define BLUECURVE_PROBE2( name, a, b )
+#define BLUECURVE_PROBE3( name, a, b, c )
+#define BLUECURVE_PROBE5( name, a, b, c, d, e )
+
+#endif
+
+#endif
+// vim: ts=4
@@ -0,0 +1,186 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Lookup table based image recoloring.
+ *
+ *	The color math is the recoloring method from the Keramik widget style,
+ *	copyright (c) 2002 Malte Starostik <malte@kde.org>.
+ */
+
+#include "bluecurverecolor.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLUECURVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace BlueCurve
+{
+
+// Plain C version, also handles the tail of the vectorized kernels.
+static void recolorScalar( TQ_UINT32* data, int count, const TQ_UINT32* table )
+{
+	for ( int i = 0; i < count; i++ )
+	{
+		TQ_UINT32 px = data[i];
+		int v = TQMAX( tqRed( px ), TQMAX( tqGreen( px ), tqBlue( px ) ) );
+		data[i] = table[v] | ( px & ~TQT_RGB_MASK );
+	}
+}
+
+#ifdef BLUECURVE_X86_KERNELS
+
+// The value of a pixel is the largest byte of its low three bytes, so
+// shifting the pixel right by one and two bytes and taking the bytewise
+// maximum leaves it in the lowest byte.
+
+__attribute__(( target( "sse2" ) ))
+static int recolorSSE2( TQ_UINT32* data, int count, const TQ_UINT32* table )
+{
+	const __m128i lowByte = _mm_set1_epi32( 0xff );
+	const __m128i alphaMask = _mm_set1_epi32( (int) ~TQT_RGB_MASK );
+	TQ_UINT32 idx[4] __attribute__(( aligned( 16 ) ));
+
+	int i = 0;
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		__m128i px = _mm_loadu_si128( reinterpret_cast< const __m128i* >( data + i ) );
+		__m128i v = _mm_max_epu8( px, _mm_srli_epi32( px, 8 ) );
+		v = _mm_max_epu8( v, _mm_srli_epi32( px, 16 ) );
+		_mm_store_si128( reinterpret_cast< __m128i* >( idx ), _mm_and_si128( v, lowByte ) );
+
+		// No gather before AVX2
+		__m128i rgb = _mm_set_epi32( table[idx[3]], table[idx[2]],
+			table[idx[1]], table[idx[0]] );
+		_mm_storeu_si128( reinterpret_cast< __m128i* >( data + i ),
+			_mm_or_si128( rgb, _mm_and_si128( px, alphaMask ) ) );
+	}
+	return i;
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static int recolorAVX2( TQ_UINT32* data, int count, const TQ_UINT32* table )
+{
+	const __m256i lowByte = _mm256_set1_epi32( 0xff );
+	const __m256i alphaMask = _mm256_set1_epi32( (int) ~TQT_RGB_MASK );
+	const int* lut = reinterpret_cast< const int* >( table );
+
+	int i = 0;
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		__m256i px = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( data + i ) );
+		__m256i v = _mm256_max_epu8( px, _mm256_srli_epi32( px, 8 ) );
+		v = _mm256_max_epu8( v, _mm256_srli_epi32( px, 16 ) );
+		__m256i rgb = _mm256_i32gather_epi32( lut, _mm256_and_si256( v, lowByte ), 4 );
+		_mm256_storeu_si256( reinterpret_cast< __m256i* >( data + i ),
+			_mm256_or_si256( rgb, _mm256_and_si256( px, alphaMask ) ) );
+	}
+	return i;
+}
+
+
+enum { KernelUnknown = 0, KernelScalar, KernelSSE2, KernelAVX2 };
+
+static int bestKernel()
+{
+	static int kernel = KernelUnknown;
+	if ( kernel == KernelUnknown )
+	{
+		__builtin_cpu_init();
+		if ( __builtin_cpu_supports( "avx2" ) )
+			kernel = KernelAVX2;
+		else if ( __builtin_cpu_supports( "sse2" ) )
+			kernel = KernelSSE2;
+		else
+			kernel = KernelScalar;
+	}
+	return kernel;
+}
+
+#endif
+
+
+Recolorer::Recolorer( const TQColor& color )
+	: m_hue( -1 ), m_sat( 0 ), m_val( 228 ), m_complete( false )
+{
+	if ( color.isValid() )
+		color.hsv( &m_hue, &m_sat, &m_val );
+
+	for ( int v = 0; v < 256; v++ )
+		m_valid[v] = false;
+}
+
+
+TQ_UINT32 Recolorer::entry( int v )
+{
+	if ( !m_valid[v] )
+	{
+		TQColor c;
+		c.setHsv( m_hue, TQMIN( m_sat, 255 ), TQMIN( v * m_val / 145, 255 ) );
+		m_table[v] = c.rgb() & TQT_RGB_MASK;
+		m_valid[v] = true;
+	}
+	return m_table[v];
+}
+
+
+// Palette images usually only touch a handful of entries, so the table is
+// filled lazily and only completed for the 32-bpp kernels.
+void Recolorer::fillTable()
+{
+	if ( m_complete )
+		return;
+
+	for ( int v = 0; v < 256; v++ )
+		entry( v );
+	m_complete = true;
+}
+
+
+TQRgb Recolorer::map( TQRgb rgb )
+{
+	int v = TQMAX( tqRed( rgb ), TQMAX( tqGreen( rgb ), tqBlue( rgb ) ) );
+	return entry( v ) | ( rgb & ~TQT_RGB_MASK );
+}
+
+
+void Recolorer::apply( TQ_UINT32* data, int count )
+{
+	fillTable();
+
+	int done = 0;
+#ifdef BLUECURVE_X86_KERNELS
+	switch ( bestKernel() )
+	{
+		case KernelAVX2:
+			done = recolorAVX2( data, count, m_table );
+			break;
+		case KernelSSE2:
+			done = recolorSSE2( data, count, m_table );
+			break;
+		default:
+			break;
+	}
+#endif
+	recolorScalar( data + done, count - done, m_table );
+}
+
+
+void Recolorer::apply( TQImage& img )
+{
+	if ( img.depth() > 8 )
+	{
+		apply( reinterpret_cast< TQ_UINT32* >( img.bits() ),
+			img.width() * img.height() );
+		return;
+	}
+
+	TQRgb* colors = img.colorTable();
+	for ( int i = 0; i < img.numColors(); i++ )
+		colors[i] = map( colors[i] );
+}
+
+}
+
+// vim: ts=4
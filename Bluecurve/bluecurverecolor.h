@@ -0,0 +1,49 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Lookup table based image recoloring.
+ */
+
+#ifndef _BLUECURVE_RECOLOR_H
+#define _BLUECURVE_RECOLOR_H
+
+#include <tqcolor.h>
+#include <tqimage.h>
+
+namespace BlueCurve {
+
+/*
+ * Recolors images towards a target color, the way the Keramik style does:
+ * every pixel takes the hue and saturation of the target, and its value
+ * is scaled by the target's value.
+ *
+ * The result only depends on the value (the largest RGB component) of the
+ * source pixel, so the conversion is a 256 entry table built once per
+ * target color. Palette images look up their color table entries, 32-bpp
+ * images go through a SSE2 or AVX2 kernel when the CPU has one.
+ */
+class Recolorer
+{
+	public:
+		Recolorer( const TQColor& color );
+
+		void apply( TQImage& img );
+		void apply( TQ_UINT32* data, int count );
+		TQRgb map( TQRgb rgb );
+
+	private:
+		TQ_UINT32 entry( int v );
+		void fillTable();
+
+		int m_hue;
+		int m_sat;
+		int m_val;
+		bool m_complete;
+		TQ_UINT32 m_table[256];
+		bool m_valid[256];
+};
+
+}
+
+#endif
+// vim: ts=4
@@ -0,0 +1,906 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Window frame rendering, independent of a live decoration.
+ *
+ *	The drawing code comes from BlueCurveClient, see bluecurveclient.cpp
+ *	for its authors.
+ */
+
+#include "bluecurverenderer.h"
+#include "bluecurveclient.h"
+#include "bluecurvecache.h"
+#include "bluecurveprobes.h"
+
+#include <tqdrawutil.h>
+#include <tqpainter.h>
+
+namespace BlueCurve
+{
+
+// Shared pixmaps, owned by BlueCurveHandler
+extern KPixmap* stippleTile;
+extern KPixmap* toolStippleTile;
+extern KPixmap* titleBuffer;
+extern GradientCache* gradientCache;
+extern KPixmap* buttonAtlas[GlyphCount][AtlasStateCount];
+extern TQPixmap* bottomLeftPix;
+extern TQPixmap* bottomRightPix;
+extern TQPixmap* abottomLeftPix;
+extern TQPixmap* abottomRightPix;
+extern TQRegion* buttonShapes;
+extern TQRegion* shapeCorners;
+extern TQSize shapeCornersMinSize;
+extern bool useGradients;
+extern bool useGradientStrips;
+extern unsigned long titleCacheBudget;
+
+// Bytes taken by the cached titlebars of all renderers
+static unsigned long titleCacheUsed = 0;
+
+/*
+ * The frame below the titlebar as nine slices, cut from the smallest
+ * frame that has all of them. Its sides and bottom are uniform between
+ * the corners, so any frame is composed from the reference frame's
+ * corner areas and the three edges tiled in between:
+ *
+ *	rows top .. h-band            the side edges
+ *	rows h-band .. h-bottom       the reference's side rows
+ *	rows h-bottom .. h            the left and right reference corners
+ *	                              around the tiled bottom edge
+ *
+ * The right side's inner line stops short of the bottom, band covers
+ * the rows where it does.
+ */
+struct FrameTiles
+{
+	int titleHeight;
+	int left;
+	int right;
+	int bottom;
+	int band;
+	KPixmap reference;
+	KPixmap leftEdge;
+	KPixmap rightEdge;
+	KPixmap bottomEdge;
+};
+
+// Indexed by active and tool window
+static FrameTiles* frameTiles[2][2];
+
+// Length of the edge tiles, so tiling takes fewer copies
+#define EDGE_TILE_LENGTH 32
+
+
+DecorationButton::DecorationButton()
+	: glyph( -1 ), pos( ButtonMid ), state( 0 ), on( false ),
+	  hidden( false ), paint( false )
+{
+}
+
+
+DecorationState::DecorationState()
+	: active( false ), tool( false ), titleHeight( BASE_BUTTON_SIZE )
+{
+}
+
+
+void DecorationState::readOptions()
+{
+	const KDecorationOptions* options = KDecoration::options();
+
+	titleColor = options->color( KDecoration::ColorTitleBar, active );
+	titleBlend = options->color( KDecoration::ColorTitleBlend, active );
+	fontColor = options->color( KDecoration::ColorFont, active );
+	frame = options->colorGroup( KDecoration::ColorFrame, active );
+}
+
+
+DecorationRenderer::DecorationRenderer()
+	: m_captionTextWidth( 0 ), m_captionAvailWidth( 0 ),
+	  m_captionActive( false ), m_captionValid( false )
+{
+	for ( int i = 0; i < 2; i++ )
+	{
+		m_titleBytes[i] = 0;
+		m_titleValid[i] = false;
+		m_backgroundBytes[i] = 0;
+		m_backgroundCaption[i] = 0;
+		m_backgroundValid[i] = false;
+	}
+}
+
+
+DecorationRenderer::~DecorationRenderer()
+{
+	invalidate();
+}
+
+
+// The caption pixmap is keyed on the text, font, focus and width only,
+// so it has to be dropped when the colors change. The titlebars and
+// backgrounds depend on the handler's stipple and gradients.
+void DecorationRenderer::invalidate()
+{
+	m_captionValid = false;
+	for ( int i = 0; i < 2; i++ )
+	{
+		releaseTitlebar( i );
+		releaseBackground( i );
+	}
+}
+
+
+static bool sameButtons( const DecorationButton& a, const DecorationButton& b )
+{
+	return a.rect == b.rect && a.glyph == b.glyph && a.pos == b.pos
+		&& a.state == b.state && a.on == b.on && a.hidden == b.hidden
+		&& a.paint == b.paint && a.icon.serialNumber() == b.icon.serialNumber();
+}
+
+
+// Whether two states have the same titlebar. The height of the window
+// and its focus don't matter, titlebars are cached per focus.
+static bool sameTitlebar( const DecorationState& a, const DecorationState& b )
+{
+	if ( a.size.width() != b.size.width() || a.titleHeight != b.titleHeight
+		|| a.tool != b.tool || a.titleRect != b.titleRect
+		|| a.caption != b.caption || !(a.font == b.font)
+		|| a.titleColor != b.titleColor || a.titleBlend != b.titleBlend
+		|| a.fontColor != b.fontColor || !(a.frame == b.frame)
+		|| a.buttons.count() != b.buttons.count() )
+		return false;
+
+	TQValueList<DecorationButton>::ConstIterator ia = a.buttons.begin();
+	TQValueList<DecorationButton>::ConstIterator ib = b.buttons.begin();
+	for ( ; ia != a.buttons.end(); ++ia, ++ib )
+		if ( !sameButtons( *ia, *ib ) )
+			return false;
+	return true;
+}
+
+
+// Whether two states have the same titlebar background, provided the
+// caption is equally wide. The stipple starts right of the caption.
+static bool sameBackground( const DecorationState& a, const DecorationState& b )
+{
+	return a.size.width() == b.size.width() && a.titleHeight == b.titleHeight
+		&& a.tool == b.tool && a.active == b.active && a.titleRect == b.titleRect
+		&& a.titleColor == b.titleColor && a.titleBlend == b.titleBlend;
+}
+
+
+// Bytes taken by a titlebar sized pixmap. The X server pads depth 24
+// pixels to 32 bits.
+static unsigned long titleBytes( const DecorationState& s )
+{
+	int depth = TQPixmap::defaultDepth();
+	int bpp = depth > 16 ? 4 : (depth + 7) / 8;
+	return (unsigned long) s.size.width()
+		* (s.titleHeight + TOP_GRABBAR_WIDTH) * bpp;
+}
+
+
+void DecorationRenderer::freeFrameTiles()
+{
+	for ( int i = 0; i < 2; i++ )
+		for ( int j = 0; j < 2; j++ )
+		{
+			delete frameTiles[i][j];
+			frameTiles[i][j] = NULL;
+		}
+}
+
+
+// The titlebar font, shrunk for tool windows
+TQFont DecorationRenderer::titleFont( bool tool )
+{
+	TQFont font = KDecoration::options()->font( true, true );
+
+	if ( tool )
+		font.setPointSize( font.pointSize()-2 );  // Shrink font by 2pt
+
+	return font;
+}
+
+
+// The pixmap for a button in its state, straight from the atlas unless
+// it shows an icon. Sticky pins show their toggle state.
+const KPixmap& DecorationRenderer::buttonPixmap( const DecorationButton& b )
+{
+	if ( b.glyph < 0 )
+		return b.icon;
+
+	int glyph = b.glyph;
+	if ( glyph == GlyphPinUp || glyph == GlyphPinDown )
+		glyph = b.on ? GlyphPinDown : GlyphPinUp;
+	return *buttonAtlas[glyph][b.state];
+}
+
+
+TQRect DecorationRenderer::titlebarRect( const DecorationState& s )
+{
+	// Includes the line above the app and below the title bar
+	return TQRect( 0, 0, s.size.width(), s.titleHeight + TOP_GRABBAR_WIDTH + 1 );
+}
+
+
+TQRect DecorationRenderer::leftSideRect( const DecorationState& s )
+{
+	int sideStart = s.titleHeight + TOP_GRABBAR_WIDTH + 1;
+	return TQRect( 0, sideStart - 1, BORDER_WIDTH, s.size.height() - sideStart + 1 );
+}
+
+
+TQRect DecorationRenderer::rightSideRect( const DecorationState& s )
+{
+	int sideStart = s.titleHeight + TOP_GRABBAR_WIDTH + 1;
+	return TQRect( s.size.width() - BORDER_WIDTH, sideStart - 1,
+		BORDER_WIDTH, s.size.height() - sideStart + 1 );
+}
+
+
+TQRect DecorationRenderer::bottomRect( const DecorationState& s )
+{
+	return TQRect( 0, s.size.height() - BORDER_WIDTH, s.size.width(), BORDER_WIDTH );
+}
+
+
+// Only the frame sections touched by the damaged region are painted,
+// everything else is clipped away.
+void DecorationRenderer::paint( TQPainter* p, const DecorationState& s,
+		const TQRegion& damage )
+{
+	p->setClipRegion( damage, TQPainter::CoordPainter );
+
+	if ( damage.contains( leftSideRect( s ) ) || damage.contains( rightSideRect( s ) )
+		|| damage.contains( bottomRect( s ) ) )
+		paintFrame( p, s );
+	if ( damage.contains( titlebarRect( s ) ) )
+		paintTitlebar( p, s );
+	paintExtents( p, s, damage );
+
+	// Draw an outer black frame
+	p->setPen( TQt::black );
+	p->drawRect( 0, 0, s.size.width(), s.size.height() );
+
+	paintCorners( p, s, damage );
+}
+
+
+// Fills the parts of the frame between the panels and the client window,
+// which the wider border sizes and the grab bar leave
+void DecorationRenderer::paintExtents( TQPainter* p, const DecorationState& s,
+		const TQRegion& damage )
+{
+	TQRegion extents = damage & TQRegion( 0, 0, s.size.width(), s.size.height() );
+	extents -= TQRegion( titlebarRect( s ) );
+	extents -= TQRegion( leftSideRect( s ) );
+	extents -= TQRegion( rightSideRect( s ) );
+	extents -= TQRegion( bottomRect( s ) );
+	extents -= TQRegion( s.client );
+
+	TQMemArray<TQRect> rects = extents.rects();
+	for ( unsigned int i = 0; i < rects.size(); i++ )
+		p->fillRect( rects[i], s.frame.background() );
+}
+
+
+// Renders the whole frame into an image, black where nothing is painted.
+// The window shape can be returned along with it.
+TQImage DecorationRenderer::render( const DecorationState& s, TQRegion* shape )
+{
+	int w = s.size.width();
+	int h = s.size.height();
+
+	KPixmap pix;
+	pix.resize( w, h );
+	pix.fill( TQt::black );
+
+	TQPainter p( &pix );
+	paint( &p, s, TQRegion( 0, 0, w, h ) );
+	p.end();
+
+	if ( shape )
+		*shape = DecorationRenderer::shape( w, h );
+
+	return pix.convertToImage();
+}
+
+
+void DecorationRenderer::paintTitlebar( TQPainter* painter, const DecorationState& s )
+{
+	int slot = s.active ? 1 : 0;
+	const KPixmap* title;
+	if ( m_titleValid[slot] && sameTitlebar( m_titleState[slot], s ) )
+		title = &m_title[slot];
+	else if ( cacheTitlebar( slot, s ) )
+	{
+		renderTitlebar( &m_title[slot], s );
+		title = &m_title[slot];
+	} else
+	{
+		renderTitlebar( titleBuffer, s );
+		title = titleBuffer;
+	}
+
+	// Line above the app and below the title bar
+	int y = s.titleHeight + TOP_GRABBAR_WIDTH;
+	painter->setPen( s.frame.dark() );
+	painter->drawLine( 0, y, s.size.width() - 1, y );
+
+	painter->drawPixmap( 0, 0, *title );
+}
+
+
+// Takes a titlebar for s out of the budget. Returns false if it doesn't
+// fit, leaving the slot empty.
+bool DecorationRenderer::cacheTitlebar( int slot, const DecorationState& s )
+{
+	releaseTitlebar( slot );
+
+	unsigned long bytes = titleBytes( s );
+	if ( titleCacheUsed + bytes > titleCacheBudget )
+		return false;
+
+	titleCacheUsed += bytes;
+	m_titleBytes[slot] = bytes;
+	m_titleState[slot] = s;
+	m_titleValid[slot] = true;
+	return true;
+}
+
+
+void DecorationRenderer::releaseTitlebar( int slot )
+{
+	titleCacheUsed -= m_titleBytes[slot];
+	m_titleBytes[slot] = 0;
+	m_titleValid[slot] = false;
+	m_title[slot] = KPixmap();
+	m_titleState[slot] = DecorationState();
+}
+
+
+/*
+ * Composes the titlebar from its layers, bottom to top:
+ *
+ *	background  gradient and stipple: size, focus, colors and where the
+ *	            caption ends
+ *	caption     see captionPixmap(): caption, font, focus and width
+ *	lines       highlights, dividers and the outline: size, focus,
+ *	            colors and the button layout
+ *	buttons     the button atlas: glyphs and button states
+ *
+ * The background and caption are cached and only re-rendered when their
+ * inputs change, the buttons come from the atlas. The lines are drawn
+ * on every composition, they are cheaper to draw than to blend.
+ */
+void DecorationRenderer::renderTitlebar( KPixmap* buffer, const DecorationState& s )
+{
+	int w  = s.size.width();
+	int titleHeight = s.titleHeight;
+	TQRect r = s.titleRect;
+
+	// Size the buffer very early before drawing begins
+	// so there is no lag during painting pixels.
+	buffer->resize( w, titleHeight + TOP_GRABBAR_WIDTH );
+
+	// The caption first, the stipple starts where it ends
+	const KPixmap& captionPix = captionPixmap( s, r.width() - 2, r.height() );
+
+	TQPainter p2( buffer );
+	int slot = s.active ? 1 : 0;
+	if ( updateBackground( slot, s ) )
+		p2.drawPixmap( 0, 0, m_background[slot] );
+	else
+		paintBackground( &p2, s );
+
+	p2.drawPixmap( r.x() + 2, TOP_GRABBAR_WIDTH, captionPix );
+	paintTitleLines( &p2, s );
+	paintButtons( &p2, s );
+	p2.end();
+}
+
+
+// Brings the cached background of slot up to date for s. Returns false
+// if it doesn't fit into the budget, then it has to be painted directly.
+bool DecorationRenderer::updateBackground( int slot, const DecorationState& s )
+{
+	if ( m_backgroundValid[slot] && m_backgroundCaption[slot] == m_captionTextWidth
+		&& sameBackground( m_backgroundState[slot], s ) )
+		return true;
+
+	releaseBackground( slot );
+	unsigned long bytes = titleBytes( s );
+	if ( titleCacheUsed + bytes > titleCacheBudget )
+		return false;
+
+	titleCacheUsed += bytes;
+	m_backgroundBytes[slot] = bytes;
+	m_backgroundState[slot] = s;
+	m_backgroundCaption[slot] = m_captionTextWidth;
+	m_backgroundValid[slot] = true;
+
+	m_background[slot].resize( s.size.width(), s.titleHeight + TOP_GRABBAR_WIDTH );
+	TQPainter p( &m_background[slot] );
+	paintBackground( &p, s );
+	p.end();
+	return true;
+}
+
+
+void DecorationRenderer::releaseBackground( int slot )
+{
+	titleCacheUsed -= m_backgroundBytes[slot];
+	m_backgroundBytes[slot] = 0;
+	m_backgroundValid[slot] = false;
+	m_background[slot] = KPixmap();
+	m_backgroundState[slot] = DecorationState();
+}
+
+
+// The background layer: the gradient, and the stipple if active and
+// available
+void DecorationRenderer::paintBackground( TQPainter* p, const DecorationState& s )
+{
+	TQRect r = s.titleRect;
+	paintTitleBackground( p, s, s.size.width(), TOP_GRABBAR_WIDTH );
+
+	KPixmap* titlePix = s.tool ? toolStippleTile : stippleTile;
+	if (s.active && titlePix)
+	{
+		int captionWidth = m_captionTextWidth + 1;
+		p->drawTiledPixmap( r.x() + 2 + 2 + captionWidth, TOP_GRABBAR_WIDTH,
+			r.width() - 2 - 4 - captionWidth,
+			s.titleHeight+1, *titlePix );
+	}
+}
+
+
+// The lines layer
+void DecorationRenderer::paintTitleLines( TQPainter* painter, const DecorationState& s )
+{
+	bool drawLeftDivider = true;
+	bool drawRightDivider = true;
+
+	int x = 0;
+	int y = 0;
+	int x2 = s.size.width() - 1;
+	int w  = s.size.width();
+	int h  = s.size.height();
+	int titleHeight = s.titleHeight;
+	const TQColorGroup& g = s.frame;
+	TQRect r = s.titleRect;
+	TQPainter& p2 = *painter;
+
+	// Main Title Bar background area
+	p2.setPen(TQt::white);
+	p2.drawLine(x + 1, y + 1, x2 - 1, y + 1);
+	// This is kind of broken...
+	// We fill in the inner part of the circle here.  This is dependent on BUTTON_DIAM
+	p2.drawLine(x + 1, y + 1, x + 1, y + TOP_GRABBAR_WIDTH + titleHeight);
+	p2.drawLine(x + 2, y + 2, x + 3, y + 2);
+	p2.drawLine(x + 2, y + 2, x + 2, y + 3);
+	p2.drawLine(x + w - 2 , y + 1, x + w - 2, y + TOP_GRABBAR_WIDTH + titleHeight);
+	p2.drawLine(x + w - 3, y + 2, x + w - 3, y + 5);
+	p2.drawLine(x + w - 4, y + 2, x + w - 3, y + 2);
+
+	if (s.active)
+	{
+		TQColor lighterColor (s.titleColor.light (150));
+		p2.setPen (lighterColor);
+		p2.drawLine (r.x(), 2, r.x() + r.width(), 2);
+		int hue, sat, val;
+		lighterColor.hsv (&hue, &sat, &val);
+		sat /= 2;
+		sat = (sat > 255) ? 255 : (int) sat;
+
+		TQColor satColor(hue, sat, val, TQColor::Hsv);
+		p2.setPen (satColor);
+		p2.drawLine (r.x(), 1, r.x() + r.width() - 2, 1);
+	}
+
+	p2.setPen(TQt::white);
+	if (s.active)
+	{
+		TQValueList<DecorationButton>::ConstIterator it;
+		for (it = s.buttons.begin(); it != s.buttons.end(); ++it)
+		{
+			int pos = (*it).pos;
+			if ((*it).hidden)
+			{
+				if (pos == ButtonRight)
+					drawRightDivider = false;
+				// FIXME: Should be LeftButtonLeft if we had it
+				if (pos == LeftButtonRight)
+					drawLeftDivider = false;
+				continue;
+			}
+			TQRect buttonSize = (*it).rect;
+			p2.setPen(TQt::white);
+			p2.drawLine (buttonSize.x() - 1, TOP_GRABBAR_WIDTH,
+			buttonSize.x() - 1, TOP_GRABBAR_WIDTH + titleHeight);
+			if (pos == ButtonRight)
+				continue;
+			else if (pos == LeftButtonRight)
+				p2.setPen(g.mid().light(120));
+			else
+				p2.setPen(g.dark());
+			p2.drawLine (buttonSize.x() + buttonSize.width(), TOP_GRABBAR_WIDTH - 1,
+				buttonSize.x() + buttonSize.width(), TOP_GRABBAR_WIDTH + titleHeight);
+		}
+	}
+
+
+	// Top Left Button Area
+	if (drawLeftDivider)
+	{
+		if (s.active)
+			p2.setPen(s.titleColor.dark (150));
+		else
+			p2.setPen(g.mid());
+		p2.drawLine (r.x() , y + 1, r.x() , y + titleHeight + TOP_GRABBAR_WIDTH);
+	}
+
+
+
+	// Top Right Button Area
+	if (drawRightDivider)
+	{
+		if (s.active)
+			p2.setPen(s.titleColor.dark (150));
+		else
+			p2.setPen(g.mid());
+		p2.drawLine (r.x() + r.width() - 2, y + 1,
+			r.x() + r.width() - 2 , y + titleHeight + TOP_GRABBAR_WIDTH);
+	}
+
+	// Black outer line
+	p2.setPen(TQt::black);
+	p2.drawRect(0,0,w,h);
+	p2.drawArc(x, y, BUTTON_DIAM, BUTTON_DIAM, 90*16, 90*16);
+	p2.drawArc(x + w - BUTTON_DIAM , y, BUTTON_DIAM, BUTTON_DIAM, 0*16, 90*16);
+}
+
+
+// Fills the titlebar background, a gradient or the plain titlebar color,
+// with its first row at y.
+void DecorationRenderer::paintTitleBackground( TQPainter* p, const DecorationState& s,
+		int w, int y )
+{
+	int titleHeight = s.titleHeight;
+	bool highcolor = useGradients && (TQPixmap::defaultDepth() > 8);
+
+	// Draw the titlebar gradient, either tiled from a narrow strip
+	// or blitted from a full-width gradient
+	const KPixmap* upperGradient = NULL;
+	const KPixmap* upperStrip = NULL;
+	if (highcolor && s.titleColor != s.titleBlend)
+	{
+		if (useGradientStrips)
+			upperStrip = gradientCache->strip( titleHeight + TOP_GRABBAR_WIDTH,
+				s.titleBlend, s.titleColor, s.active );
+		else
+			upperGradient = gradientCache->gradient( w, titleHeight + TOP_GRABBAR_WIDTH,
+				s.titleBlend, s.titleColor, s.active );
+	}
+
+	if (upperStrip)
+		p->drawTiledPixmap(0, y, w, titleHeight + TOP_GRABBAR_WIDTH, *upperStrip);
+	else if (upperGradient)
+		p->drawPixmap(0, y, *upperGradient, 0, 0, w, titleHeight + TOP_GRABBAR_WIDTH);
+	else
+		p->fillRect(0, y, w, titleHeight, s.titleColor);
+}
+
+
+// Returns the caption drawn over the titlebar background, for a caption
+// area of the given size. The pixmap only covers the text itself, it is
+// re-rendered when the caption, font, focus or available width change.
+const KPixmap& DecorationRenderer::captionPixmap( const DecorationState& s,
+		int availWidth, int height )
+{
+	if (m_captionValid && m_captionActive == s.active
+		&& m_captionAvailWidth == availWidth && m_captionFont == s.font
+		&& m_captionText == s.caption)
+		return m_captionPix;
+
+	if (!m_captionValid || m_captionText != s.caption || !(m_captionFont == s.font))
+	{
+		TQFontMetrics fm(s.font);
+		m_captionText = s.caption;
+		m_captionTextWidth = fm.width(s.caption);
+	}
+
+	m_captionFont = s.font;
+	m_captionActive = s.active;
+	m_captionAvailWidth = availWidth;
+	m_captionValid = true;
+
+	// Text plus its shadow and a pixel for overhangs, clipped to the
+	// available area like drawText() does.
+	int w = TQMIN(m_captionTextWidth + 3, availWidth);
+	if (w <= 0)
+	{
+		m_captionPix = KPixmap();
+		return m_captionPix;
+	}
+
+	m_captionPix.resize(w, s.titleHeight);
+	TQPainter p(&m_captionPix);
+	paintTitleBackground(&p, s, w, 0);
+	p.setFont(s.font);
+
+	if (s.active)
+	{
+		p.setPen( s.titleBlend.dark() );
+		p.drawText(1, 1, availWidth - 1, height,
+			TQt::AlignLeft | TQt::AlignVCenter, m_captionText );
+	}
+
+	p.setPen( s.fontColor );
+	p.drawText(0, 0, availWidth, height,
+		TQt::AlignLeft | TQt::AlignVCenter, m_captionText );
+	p.end();
+
+	return m_captionPix;
+}
+
+
+// Draws the buttons which have no widget of their own, clipped to the
+// same rounded shapes the button widgets get.
+void DecorationRenderer::paintButtons( TQPainter* p, const DecorationState& s )
+{
+	TQValueList<DecorationButton>::ConstIterator it;
+	for (it = s.buttons.begin(); it != s.buttons.end(); ++it)
+	{
+		const DecorationButton& b = *it;
+		if (!b.paint || b.hidden)
+			continue;
+
+		BLUECURVE_PROBE2( button_entry, b.glyph, b.state );
+		const KPixmap& pix = buttonPixmap( b );
+		if (b.pos == ButtonLeft || b.pos == ButtonRight)
+		{
+			TQRegion shape = buttonShapes[b.pos == ButtonLeft ? 0 : 1];
+			shape.translate( b.rect.x(), b.rect.y() );
+			p->setClipRegion( shape );
+			p->drawPixmap( b.rect.topLeft(), pix );
+			p->setClipping( false );
+		} else
+			p->drawPixmap( b.rect.topLeft(), pix );
+		BLUECURVE_PROBE2( button_return, b.glyph, b.state );
+	}
+}
+
+
+// Paints the sides and the bottom with its corners from the frame tiles
+// for s, which are made on first use. Frames smaller than the reference
+// are painted directly.
+void DecorationRenderer::paintFrame( TQPainter* p, const DecorationState& s )
+{
+	int top = s.titleHeight + TOP_GRABBAR_WIDTH + 1;
+	FrameTiles*& slot = frameTiles[s.active ? 1 : 0][s.tool ? 1 : 0];
+	if ( slot && slot->titleHeight != s.titleHeight )
+	{
+		delete slot;
+		slot = NULL;
+	}
+
+	if ( !slot )
+	{
+		FrameTiles* t = new FrameTiles;
+		t->titleHeight = s.titleHeight;
+		t->left = TQMAX( BORDER_WIDTH, bottomLeftPix->width() );
+		t->right = TQMAX( BORDER_WIDTH, bottomRightPix->width() );
+		t->bottom = TQMAX( BORDER_WIDTH,
+			TQMAX( bottomLeftPix->height(), bottomRightPix->height() ) );
+		t->band = TQMAX( top + 1, t->bottom );
+
+		// One row of side edge, one column of bottom edge
+		DecorationState ref = s;
+		ref.size = TQSize( t->left + t->right + 1, top + t->band + 1 );
+		t->reference.resize( ref.size );
+		t->reference.fill( s.frame.background() );
+
+		TQPainter rp( &t->reference );
+		paintLeftSide( &rp, ref );
+		paintRightSide( &rp, ref );
+		paintBottom( &rp, ref );
+		rp.setPen( TQt::black );
+		rp.drawRect( 0, 0, ref.size.width(), ref.size.height() );
+		paintCorners( &rp, ref, TQRegion( TQRect( TQPoint( 0, 0 ), ref.size ) ) );
+		rp.end();
+
+		int rw = ref.size.width();
+		int by = ref.size.height() - t->bottom;
+		t->leftEdge.resize( BORDER_WIDTH, EDGE_TILE_LENGTH );
+		t->rightEdge.resize( BORDER_WIDTH, EDGE_TILE_LENGTH );
+		t->bottomEdge.resize( EDGE_TILE_LENGTH, t->bottom );
+		for ( int i = 0; i < EDGE_TILE_LENGTH; i++ )
+		{
+			bitBlt( &t->leftEdge, 0, i, &t->reference, 0, top, BORDER_WIDTH, 1 );
+			bitBlt( &t->rightEdge, 0, i, &t->reference, rw - BORDER_WIDTH, top,
+				BORDER_WIDTH, 1 );
+			bitBlt( &t->bottomEdge, i, 0, &t->reference, t->left, by, 1, t->bottom );
+		}
+
+		slot = t;
+	}
+
+	const FrameTiles* t = slot;
+	int w = s.size.width();
+	int h = s.size.height();
+	int rw = t->reference.width();
+	int rh = t->reference.height();
+
+	if ( w < rw || h < rh )
+	{
+		paintLeftSide( p, s );
+		paintRightSide( p, s );
+		paintBottom( p, s );
+		return;
+	}
+
+	// The sides
+	int mid = h - t->band - top;
+	p->drawTiledPixmap( 0, top, BORDER_WIDTH, mid, t->leftEdge );
+	p->drawTiledPixmap( w - BORDER_WIDTH, top, BORDER_WIDTH, mid, t->rightEdge );
+
+	// The sides above the bottom
+	int rows = t->band - t->bottom;
+	p->drawPixmap( 0, h - t->band, t->reference,
+		0, rh - t->band, BORDER_WIDTH, rows );
+	p->drawPixmap( w - BORDER_WIDTH, h - t->band, t->reference,
+		rw - BORDER_WIDTH, rh - t->band, BORDER_WIDTH, rows );
+
+	// The bottom and its corners
+	int y = h - t->bottom;
+	int ry = rh - t->bottom;
+	p->drawPixmap( 0, y, t->reference, 0, ry, t->left, t->bottom );
+	p->drawTiledPixmap( t->left, y, w - t->left - t->right, t->bottom, t->bottomEdge );
+	p->drawPixmap( w - t->right, y, t->reference, rw - t->right, ry, t->right, t->bottom );
+}
+
+
+void DecorationRenderer::paintLeftSide( TQPainter* p, const DecorationState& s )
+{
+	int sideStart = s.titleHeight + TOP_GRABBAR_WIDTH + 1;
+	const TQColorGroup& g = s.frame;
+
+	qDrawShadePanel(p,
+		// We compensate for the top and bottom parts of the bevel
+		// by drawing 1 pixel below and above the frame part
+		1, sideStart - 1,
+		BORDER_WIDTH - 1, s.size.height() - (sideStart + 2),
+		g, false, 1, &g.brush(TQColorGroup::Background));
+}
+
+
+void DecorationRenderer::paintRightSide( TQPainter* p, const DecorationState& s )
+{
+	int sideStart = s.titleHeight + TOP_GRABBAR_WIDTH + 1;
+	int x2 = s.size.width() - 1;
+	int h = s.size.height();
+	const TQColorGroup& g = s.frame;
+
+	qDrawShadePanel(p,
+		x2 - (BORDER_WIDTH - 2), sideStart - 1,
+		BORDER_WIDTH - 2, h - (sideStart + 2),
+		g, false, 1, &g.brush(TQColorGroup::Background));
+
+	p->setPen(g.dark());
+	p->drawLine(x2 - (BORDER_WIDTH - 1), sideStart, x2 - (BORDER_WIDTH - 1), h - sideStart);
+}
+
+
+void DecorationRenderer::paintBottom( TQPainter* p, const DecorationState& s )
+{
+	int x2 = s.size.width() - 1;
+	int y2 = s.size.height() - 1;
+	const TQColorGroup& g = s.frame;
+
+	qDrawShadePanel(p,
+		0, y2 - (BORDER_WIDTH - 2),
+		s.size.width(), (BORDER_WIDTH - 2),
+		g, false, 1, &g.brush(TQColorGroup::Background));
+	p->setPen(g.dark());
+	p->drawLine(0, y2 - (BORDER_WIDTH - 1), x2, y2 - (BORDER_WIDTH - 1));
+}
+
+
+void DecorationRenderer::paintCorners( TQPainter* p, const DecorationState& s,
+		const TQRegion& damage )
+{
+	int w = s.size.width();
+	int h = s.size.height();
+
+	TQRect left(0, h - bottomLeftPix->height(),
+		bottomLeftPix->width(), bottomLeftPix->height());
+	TQRect right(w - bottomRightPix->width(), h - bottomRightPix->height(),
+		bottomRightPix->width(), bottomRightPix->height());
+
+	if (damage.contains(left))
+		p->drawPixmap(left.topLeft(), s.active ? *abottomLeftPix : *bottomLeftPix);
+	if (damage.contains(right))
+		p->drawPixmap(right.topLeft(), s.active ? *abottomRightPix : *bottomRightPix);
+}
+
+
+// Paints the shape of a w x h decoration into a bitmap. Only used to
+// derive the corner regions and for windows smaller than those corners.
+TQBitmap DecorationRenderer::shapeBitmap( int w, int h )
+{
+	int x = 0;
+	int y = 0;
+
+	int rad = BUTTON_DIAM / 2;
+	int dm = BUTTON_DIAM;
+
+	TQBitmap mask(w+1, h+1, true);
+
+	TQPainter p(&mask);
+
+	p.fillRect(x, y, w+1, h+1, TQt::color1);
+
+	p.eraseRect(x, y, rad, rad);
+	p.eraseRect(w-rad+1, 0, rad, rad);
+
+	p.eraseRect(x, h-BOTTOM_CORNER, BOTTOM_CORNER, BOTTOM_CORNER);
+	p.eraseRect(w-BOTTOM_CORNER, h-BOTTOM_CORNER, BOTTOM_CORNER, BOTTOM_CORNER);
+
+	p.setPen(TQt::color1);
+	p.setBrush(TQt::color1);
+
+	p.drawPie(x, y, dm, dm, 90*16, 90*16);
+	p.drawArc(x, y, dm, dm, 90*16, 90*16);
+
+	p.drawPie(w-dm, 0, dm, dm, 0*16, 90*16);
+	p.drawArc(w-dm, 0, dm, dm, 0*16, 90*16);
+
+	p.drawPixmap(x, h - bottomLeftPix->height(), *bottomLeftPix->mask());
+
+	p.drawPixmap(w-bottomRightPix->width(), h - bottomRightPix->height(),
+		*bottomRightPix->mask());
+	p.fillRect(x+BOTTOM_CORNER, h - bottomLeftPix->height(),
+		bottomLeftPix->width()-BOTTOM_CORNER,
+		bottomLeftPix->height()-BOTTOM_CORNER,
+		TQt::color1);
+
+	p.fillRect(w-bottomRightPix->width(), h - bottomRightPix->height(),
+		bottomRightPix->width()-BOTTOM_CORNER,
+		bottomRightPix->height()-BOTTOM_CORNER,
+		TQt::color1);
+
+	p.end();
+	return mask;
+}
+
+
+// The window shape of a w x h decoration
+TQRegion DecorationRenderer::shape( int w, int h )
+{
+	if ( w < shapeCornersMinSize.width() || h < shapeCornersMinSize.height() )
+		return TQRegion( shapeBitmap( w, h ) );
+
+	// The full rectangle minus the precomputed corner cutouts
+	TQRegion mask( 0, 0, w+1, h+1 );
+	TQRegion corner;
+
+	mask -= shapeCorners[0];
+	corner = shapeCorners[1];
+	corner.translate( w, 0 );
+	mask -= corner;
+	corner = shapeCorners[2];
+	corner.translate( 0, h );
+	mask -= corner;
+	corner = shapeCorners[3];
+	corner.translate( w, h );
+	mask -= corner;
+
+	return mask;
+}
+
+}
+
+// vim: ts=4
@@ -0,0 +1,163 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Window frame rendering, independent of a live decoration.
+ */
+
+#ifndef _BLUECURVE_RENDERER_H
+#define _BLUECURVE_RENDERER_H
+
+#include <tqbitmap.h>
+#include <tqfont.h>
+#include <tqimage.h>
+#include <tqpalette.h>
+#include <tqregion.h>
+#include <tqvaluelist.h>
+#include <kpixmap.h>
+
+class TQPainter;
+
+#define BASE_BUTTON_SIZE  17
+#define BORDER_WIDTH      6
+#define CORNER_RADIUS     12
+
+#define BUTTON_DIAM       12
+#define TOP_GRABBAR_WIDTH 2
+#define BOTTOM_CORNER     5
+
+namespace BlueCurve {
+
+// A titlebar button as far as the frame is concerned
+struct DecorationButton
+{
+	DecorationButton();
+
+	TQRect rect;
+	int glyph;      // ButtonGlyph, -1 to draw icon instead
+	int pos;        // ButtonPos
+	int state;      // ButtonAtlasState bits
+	bool on;        // Sticky pins only
+	bool hidden;
+	bool paint;     // Drawn into the titlebar, not by a button widget
+	KPixmap icon;
+};
+
+// Everything that determines what a decoration looks like
+struct DecorationState
+{
+	DecorationState();
+
+	// Takes the colors for active from the decoration options
+	void readOptions();
+
+	TQSize size;
+	TQString caption;
+	bool active;
+	bool tool;
+	int titleHeight;
+	TQRect titleRect;
+	TQValueList<DecorationButton> buttons;
+
+	TQRect client;  // Where the client window goes, empty if nowhere
+
+	TQFont font;
+	TQColor titleColor;
+	TQColor titleBlend;
+	TQColor fontColor;
+	TQColorGroup frame;
+};
+
+/*
+ * Paints the window frame for a DecorationState, using the pixmaps the
+ * handler shares between all decorations. BlueCurveClient paints itself
+ * through one, and since nothing here needs a decoration or a widget,
+ * the same code can render frames into images for tests and benchmarks.
+ *
+ * A renderer keeps the last caption it drew, and the titlebar as last
+ * rendered for either focus state, so there should be one per decoration.
+ * With both titlebars cached, a focus change only blits. A titlebar is
+ * composed from layers, see renderTitlebar(), and only the layers whose
+ * inputs changed are rendered again: a hover redraws the lines and
+ * buttons over the cached background and caption.
+ *
+ * The titlebars and backgrounds of all renderers share a budget, those
+ * that don't fit are rendered into the shared titleBuffer on every paint
+ * instead.
+ *
+ * The sides are always BORDER_WIDTH wide, the configured border size
+ * only changes the frame extents twin reserves. What of those extents
+ * the sides and the bottom don't reach is filled with the background.
+ */
+class DecorationRenderer
+{
+	public:
+		DecorationRenderer();
+		~DecorationRenderer();
+
+		void paint( TQPainter* p, const DecorationState& s, const TQRegion& damage );
+		TQImage render( const DecorationState& s, TQRegion* shape = NULL );
+
+		// Drops the cached caption and titlebars, for changes which are
+		// not part of the DecorationState, like the handler's pixmaps
+		void invalidate();
+
+		// Drops the frame tiles, when the colors or corners change
+		static void freeFrameTiles();
+
+		static TQFont titleFont( bool tool );
+		static const KPixmap& buttonPixmap( const DecorationButton& b );
+		static TQRegion shape( int w, int h );
+		static TQBitmap shapeBitmap( int w, int h );
+
+		static TQRect titlebarRect( const DecorationState& s );
+		static TQRect leftSideRect( const DecorationState& s );
+		static TQRect rightSideRect( const DecorationState& s );
+		static TQRect bottomRect( const DecorationState& s );
+
+	private:
+		void paintTitlebar( TQPainter* p, const DecorationState& s );
+		void renderTitlebar( KPixmap* buffer, const DecorationState& s );
+		bool cacheTitlebar( int slot, const DecorationState& s );
+		void releaseTitlebar( int slot );
+		bool updateBackground( int slot, const DecorationState& s );
+		void releaseBackground( int slot );
+		void paintBackground( TQPainter* p, const DecorationState& s );
+		void paintTitleBackground( TQPainter* p, const DecorationState& s, int w, int y );
+		void paintTitleLines( TQPainter* p, const DecorationState& s );
+		const KPixmap& captionPixmap( const DecorationState& s, int availWidth, int height );
+		void paintButtons( TQPainter* p, const DecorationState& s );
+		void paintFrame( TQPainter* p, const DecorationState& s );
+		void paintLeftSide( TQPainter* p, const DecorationState& s );
+		void paintRightSide( TQPainter* p, const DecorationState& s );
+		void paintBottom( TQPainter* p, const DecorationState& s );
+		void paintCorners( TQPainter* p, const DecorationState& s, const TQRegion& damage );
+		void paintExtents( TQPainter* p, const DecorationState& s, const TQRegion& damage );
+
+		// The pre-rendered caption
+		KPixmap       m_captionPix;
+		TQString      m_captionText;
+		TQFont        m_captionFont;
+		int           m_captionTextWidth;
+		int           m_captionAvailWidth;
+		bool          m_captionActive;
+		bool          m_captionValid;
+
+		// The titlebars, indexed by focus, and the states they show
+		KPixmap       m_title[2];
+		DecorationState m_titleState[2];
+		unsigned long m_titleBytes[2];
+		bool          m_titleValid[2];
+
+		// The titlebar backgrounds, indexed by focus, the states and
+		// caption widths they were rendered for
+		KPixmap       m_background[2];
+		DecorationState m_backgroundState[2];
+		int           m_backgroundCaption[2];
+		unsigned long m_backgroundBytes[2];
+		bool          m_backgroundValid[2];
+};
+
+}
+
+#endif
+// vim: ts=4
@@ -0,0 +1,202 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Drop shadows composed from pre-blurred tiles.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "bluecurveshadow.h"
+
+#include <tqwidget.h>
+
+#include <math.h>
+
+#include <X11/Xlib.h>
+#ifdef HAVE_XRENDER
+#include <X11/extensions/Xrender.h>
+#endif
+
+namespace BlueCurve
+{
+
+/*
+ * The pieces are cut from the shadow of a reference frame just large
+ * enough for the corners, at m, m in a canvas with a margin of m around
+ * it. The edges are the middle row or column of the margin.
+ */
+ShadowTiles::ShadowTiles( int size, int opacity, const TQSize& cornerSize )
+	: m_size( size ), m_opacity( opacity / 100.0 ), m_cornerSize( cornerSize ),
+	  m_valid( false )
+{
+	for ( int i = 0; i < PieceCount; i++ )
+		m_pieces[i] = 0;
+
+#ifdef HAVE_XRENDER
+	Display* dpy = tqt_xdisplay();
+	int event, error;
+	if ( !XRenderQueryExtension( dpy, &event, &error ) )
+		return;
+
+	XRenderPictFormat* argb = XRenderFindStandardFormat( dpy, PictStandardARGB32 );
+	if ( !argb )
+		return;
+
+	Window root = DefaultRootWindow( dpy );
+	XRenderColor color = { 0, 0, 0, 0 };
+	TQRect reference( m_size, m_size, 2 * cornerSize.width(), 2 * cornerSize.height() );
+
+	for ( int i = 0; i < PieceCount; i++ )
+	{
+		TQRect r = pieceRect( i, reference );
+
+		// The edges are only one pixel long and repeat
+		XRenderPictureAttributes attr;
+		attr.repeat = True;
+		bool edge = (i == Top || i == Left || i == Right || i == Bottom);
+		if ( i == Top || i == Bottom )
+			r.setWidth( 1 );
+		else if ( i == Left || i == Right )
+			r.setHeight( 1 );
+
+		Pixmap pix = XCreatePixmap( dpy, root, r.width(), r.height(), 32 );
+		m_pieces[i] = XRenderCreatePicture( dpy, pix, argb, edge ? CPRepeat : 0, &attr );
+		XFreePixmap( dpy, pix );
+
+		color.alpha = 0;
+		XRenderFillRectangle( dpy, PictOpSrc, m_pieces[i], &color,
+			0, 0, r.width(), r.height() );
+		for ( int y = 0; y < r.height(); y++ )
+			for ( int x = 0; x < r.width(); x++ )
+			{
+				int a = alpha( r.x() + x, r.y() + y );
+				if ( a == 0 )
+					continue;
+				color.alpha = a * 257;
+				XRenderFillRectangle( dpy, PictOpSrc, m_pieces[i], &color, x, y, 1, 1 );
+			}
+	}
+
+	m_valid = true;
+#else
+	Q_UNUSED( cornerSize );
+#endif
+}
+
+
+ShadowTiles::~ShadowTiles()
+{
+#ifdef HAVE_XRENDER
+	Display* dpy = tqt_xdisplay();
+	for ( int i = 0; i < PieceCount; i++ )
+		if ( m_pieces[i] )
+			XRenderFreePicture( dpy, m_pieces[i] );
+#endif
+}
+
+
+// The blurred coverage of the interval from a to b at pixel x
+static double blur( double a, double b, double x, double sigma )
+{
+	double s = sigma * M_SQRT2;
+	return 0.5 * (erfc( (a - x) / s ) - erfc( (b - x) / s ));
+}
+
+
+// The shadow alpha of canvas pixel x, y, 0 to 255
+int ShadowTiles::alpha( int x, int y ) const
+{
+	double sigma = TQMAX( m_size / 3.0, 0.5 );
+	double l = m_size;
+	double t = m_size;
+	double r = l + 2 * m_cornerSize.width();
+	double b = t + 2 * m_cornerSize.height();
+
+	double a = m_opacity * blur( l, r, x + 0.5, sigma ) * blur( t, b, y + 0.5, sigma );
+	return TQMIN( (int) (a * 255 + 0.5), 255 );
+}
+
+
+TQRect ShadowTiles::pieceRect( int piece, const TQRect& frame ) const
+{
+	int m = m_size;
+	int cw = m_cornerSize.width();
+	int ch = m_cornerSize.height();
+	int left = frame.left() - m;
+	int right = frame.right() + 1 - cw;
+	int top = frame.top() - m;
+	int bottom = frame.bottom() + 1 - ch;
+
+	switch ( piece )
+	{
+		case TopLeft:     return TQRect( left, top, m + cw, m + ch );
+		case Top:         return TQRect( frame.left() + cw, top, frame.width() - 2*cw, m );
+		case TopRight:    return TQRect( right, top, m + cw, m + ch );
+		case Left:        return TQRect( left, frame.top() + ch, m, frame.height() - 2*ch );
+		case Right:       return TQRect( frame.right() + 1, frame.top() + ch,
+		                                 m, frame.height() - 2*ch );
+		case BottomLeft:  return TQRect( left, bottom, m + cw, m + ch );
+		case Bottom:      return TQRect( frame.left() + cw, frame.bottom() + 1,
+		                                 frame.width() - 2*cw, m );
+		default:          return TQRect( right, bottom, m + cw, m + ch );
+	}
+}
+
+
+void ShadowTiles::paint( TQWidget* w, const TQRect& frame, const TQRegion& damage ) const
+{
+#ifdef HAVE_XRENDER
+	if ( !m_valid )
+		return;
+
+	Display* dpy = w->x11Display();
+	XRenderPictFormat* format = XRenderFindVisualFormat( dpy, (Visual*) w->x11Visual() );
+	if ( !format )
+		return;
+	Picture target = XRenderCreatePicture( dpy, w->winId(), format, 0, NULL );
+	paint( target, frame, damage );
+	XRenderFreePicture( dpy, target );
+#else
+	Q_UNUSED( w );
+	Q_UNUSED( frame );
+	Q_UNUSED( damage );
+#endif
+}
+
+
+// A composite for every rectangle of damage in a piece
+void ShadowTiles::paint( TQt::HANDLE picture, const TQRect& frame,
+		const TQRegion& damage ) const
+{
+#ifdef HAVE_XRENDER
+	if ( !m_valid )
+		return;
+
+	Display* dpy = tqt_xdisplay();
+	for ( int i = 0; i < PieceCount; i++ )
+	{
+		TQRect piece = pieceRect( i, frame );
+		if ( piece.isEmpty() )
+			continue;
+
+		TQMemArray<TQRect> rects = (damage & TQRegion( piece )).rects();
+		for ( unsigned int j = 0; j < rects.size(); j++ )
+		{
+			const TQRect& r = rects[j];
+			XRenderComposite( dpy, PictOpSrc, m_pieces[i], None, picture,
+				r.x() - piece.x(), r.y() - piece.y(), 0, 0,
+				r.x(), r.y(), r.width(), r.height() );
+		}
+	}
+#else
+	Q_UNUSED( picture );
+	Q_UNUSED( frame );
+	Q_UNUSED( damage );
+#endif
+}
+
+}
+
+// vim: ts=4
@@ -0,0 +1,62 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Drop shadows composed from pre-blurred tiles.
+ */
+
+#ifndef _BLUECURVE_SHADOW_H
+#define _BLUECURVE_SHADOW_H
+
+#include <tqregion.h>
+#include <tqsize.h>
+
+class TQWidget;
+
+namespace BlueCurve {
+
+/*
+ * The shadow of a frame on a composited desktop, blurred once for a
+ * reference frame and cut into eight pieces: four corners, which reach
+ * cornerSize into the frame so the shadow shows through its transparent
+ * corners, and four edges one pixel long. The edges are repeating XRender
+ * pictures, so the shadow of any frame takes the same eight composites,
+ * whatever its size.
+ *
+ * The blur is a gaussian with a third of the shadow size as its standard
+ * deviation. For a rectangle that is the product of two one dimensional
+ * blurs, so the tiles are computed directly instead of being blurred.
+ */
+class ShadowTiles
+{
+	public:
+		// size is the margin around the frame, opacity from 0 to 100
+		ShadowTiles( int size, int opacity, const TQSize& cornerSize );
+		~ShadowTiles();
+
+		bool isValid() const { return m_valid; }
+		int size() const { return m_size; }
+
+		// Paints the shadow of the frame at frame into the parts of
+		// damage around it and under its corners, on w or an XRender
+		// picture
+		void paint( TQWidget* w, const TQRect& frame, const TQRegion& damage ) const;
+		void paint( TQt::HANDLE picture, const TQRect& frame, const TQRegion& damage ) const;
+
+	private:
+		enum { TopLeft = 0, Top, TopRight, Left, Right, BottomLeft, Bottom,
+			BottomRight, PieceCount };
+
+		TQRect pieceRect( int piece, const TQRect& frame ) const;
+		int alpha( int x, int y ) const;
+
+		int m_size;
+		double m_opacity;
+		TQSize m_cornerSize;
+		TQt::HANDLE m_pieces[ PieceCount ];   // ARGB32 pictures
+		bool m_valid;
+};
+
+}
+
+#endif
+// vim: ts=4
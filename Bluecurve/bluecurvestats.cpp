@@ -0,0 +1,192 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Call counts and latency histograms of the decoration's operations.
+ */
+
+#include "bluecurvestats.h"
+#include "bluecurvecache.h"
+
+#include <kdebug.h>
+#include <tqsocketnotifier.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace BlueCurve
+{
+
+bool statsEnabled = false;
+
+// Owned by BlueCurveHandler, counts its hits itself
+extern GradientCache* gradientCache;
+
+static const char* opNames[StatOpCount] = { "paintEvent", "doShape",
+	"resizeEvent", "calcHiddenButtons", "drawButton", "createPixmaps",
+	"reset" };
+
+static const char* counterNames[StatCounterCount] = {
+	"captions replaced before being painted" };
+
+unsigned long DecorationStats::counters[StatCounterCount];
+
+struct OpStat
+{
+	unsigned long count;
+	double total;
+	unsigned long max;
+	unsigned long buckets[STAT_BUCKETS];
+};
+
+static OpStat opStats[StatOpCount];
+static DecorationStats* instance;
+
+// SIGUSR2 only writes to the pipe, the dump happens in the event loop
+static int signalPipe[2] = { -1, -1 };
+static struct sigaction oldSigusr2;
+
+
+// A full pipe already has a dump pending, so a failed write is dropped.
+// The interrupted code may still look at errno.
+static void sigusr2Handler( int )
+{
+	int savedErrno = errno;
+	char c = 0;
+	ssize_t n = ::write( signalPipe[1], &c, 1 );
+	(void) n;
+	errno = savedErrno;
+}
+
+
+void DecorationStats::setEnabled( bool enable )
+{
+	if ( enable == statsEnabled )
+		return;
+
+	if ( enable )
+	{
+		for ( int i = 0; i < StatOpCount; i++ )
+			memset( &opStats[i], 0, sizeof( OpStat ) );
+		for ( int i = 0; i < StatCounterCount; i++ )
+			counters[i] = 0;
+		instance = new DecorationStats();
+		statsEnabled = true;
+	} else
+	{
+		statsEnabled = false;
+		dump();
+		delete instance;
+		instance = NULL;
+	}
+}
+
+
+void DecorationStats::record( int op, const timespec& start )
+{
+	timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	unsigned long us = (now.tv_sec - start.tv_sec) * 1000000
+		+ (now.tv_nsec - start.tv_nsec) / 1000;
+
+	int b = 0;
+	while ( b < STAT_BUCKETS - 1 && (us >> b) )
+		b++;
+
+	OpStat& s = opStats[op];
+	s.count++;
+	s.total += us;
+	if ( us > s.max )
+		s.max = us;
+	s.buckets[b]++;
+}
+
+
+// Writes as a warning, so the statistics also show up in release builds
+void DecorationStats::dump()
+{
+	for ( int i = 0; i < StatOpCount; i++ )
+	{
+		const OpStat& s = opStats[i];
+		if ( !s.count )
+			continue;
+
+		kdWarning(1212) << "BlueCurve: " << opNames[i] << ": " << s.count
+			<< " calls, mean " << (unsigned long) (s.total / s.count)
+			<< " us, max " << s.max << " us" << endl;
+
+		for ( int b = 0; b < STAT_BUCKETS; b++ )
+		{
+			if ( !s.buckets[b] )
+				continue;
+
+			TQString range = (b == 0) ? TQString( "< 1" )
+				: (b == STAT_BUCKETS - 1) ? TQString( ">= %1" ).arg( 1UL << (b - 1) )
+				: TQString( "%1 - %2" ).arg( 1UL << (b - 1) ).arg( (1UL << b) - 1 );
+			kdWarning(1212) << "BlueCurve:   " << range << " us: " << s.buckets[b] << endl;
+		}
+	}
+
+	for ( int i = 0; i < StatCounterCount; i++ )
+		kdWarning(1212) << "BlueCurve: " << counterNames[i] << ": " << counters[i] << endl;
+
+	if ( gradientCache )
+		kdWarning(1212) << "BlueCurve: gradient cache: " << gradientCache->hits()
+			<< " hits, " << gradientCache->misses() << " misses" << endl;
+}
+
+
+DecorationStats::DecorationStats()
+	: m_notifier( NULL )
+{
+	if ( ::socketpair( AF_UNIX, SOCK_STREAM, 0, signalPipe ) < 0 )
+		return;
+	fcntl( signalPipe[0], F_SETFD, FD_CLOEXEC );
+	fcntl( signalPipe[1], F_SETFD, FD_CLOEXEC );
+	fcntl( signalPipe[1], F_SETFL, O_NONBLOCK );
+
+	m_notifier = new TQSocketNotifier( signalPipe[0], TQSocketNotifier::Read, this );
+	connect( m_notifier, TQ_SIGNAL(activated(int)), this, TQ_SLOT(dumpRequested()) );
+
+	struct sigaction sa;
+	memset( &sa, 0, sizeof( sa ) );
+	sa.sa_handler = sigusr2Handler;
+	sigemptyset( &sa.sa_mask );
+	sa.sa_flags = SA_RESTART;
+	sigaction( SIGUSR2, &sa, &oldSigusr2 );
+}
+
+
+DecorationStats::~DecorationStats()
+{
+	if ( !m_notifier )
+		return;
+
+	sigaction( SIGUSR2, &oldSigusr2, NULL );
+	delete m_notifier;
+	::close( signalPipe[0] );
+	::close( signalPipe[1] );
+	signalPipe[0] = signalPipe[1] = -1;
+}
+
+
+void DecorationStats::dumpRequested()
+{
+	char buf[16];
+	if ( ::read( signalPipe[0], buf, sizeof( buf ) ) <= 0 )
+	{
+		// The other end is gone, stop listening instead of spinning
+		m_notifier->setEnabled( false );
+		return;
+	}
+	dump();
+}
+
+}
+
+#include "bluecurvestats.moc"
+
+// vim: ts=4
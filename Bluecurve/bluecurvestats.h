@@ -0,0 +1,91 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Call counts and latency histograms of the decoration's operations.
+ */
+
+#ifndef _BLUECURVE_STATS_H
+#define _BLUECURVE_STATS_H
+
+#include <tqobject.h>
+
+#include <time.h>
+
+class TQSocketNotifier;
+
+namespace BlueCurve {
+
+// The timed operations
+enum StatOp { StatPaint = 0, StatShape, StatResize, StatHiddenButtons,
+	StatButtonPaint, StatCreatePixmaps, StatReset, StatOpCount };
+
+// The counted events
+enum StatCounter { StatDroppedCaptions = 0, StatCounterCount };
+
+// Bucket b counts the calls taking less than 2^b us, and at least half
+// of that. The last bucket takes everything longer.
+#define STAT_BUCKETS 24
+
+extern bool statsEnabled;
+
+/*
+ * Collects the statistics while CollectStats is set in the BlueCurve
+ * group. They are written to the twin log when twin gets SIGUSR2, and
+ * once more when collecting is switched off:
+ *
+ *	kill -USR2 `pidof twin`
+ *
+ * Events which take no time worth measuring are only counted. Either
+ * costs a test of statsEnabled when disabled.
+ */
+class DecorationStats : public TQObject
+{
+	TQ_OBJECT
+
+	public:
+		static void setEnabled( bool enable );
+		static void record( int op, const timespec& start );
+		static void count( int counter )
+		{
+			if ( statsEnabled )
+				counters[counter]++;
+		}
+		static void dump();
+
+	private slots:
+		void dumpRequested();
+
+	private:
+		DecorationStats();
+		~DecorationStats();
+
+		static unsigned long counters[StatCounterCount];
+
+		TQSocketNotifier* m_notifier;
+};
+
+// Times the enclosing scope as one call of op
+class StatTimer
+{
+	public:
+		StatTimer( int op ) : m_op( statsEnabled ? op : -1 )
+		{
+			if ( m_op >= 0 )
+				clock_gettime( CLOCK_MONOTONIC, &m_start );
+		}
+
+		~StatTimer()
+		{
+			if ( m_op >= 0 )
+				DecorationStats::record( m_op, m_start );
+		}
+
+	private:
+		int m_op;
+		timespec m_start;
+};
+
+}
+
+#endif
+// vim: ts=4
@@ -0,0 +1,201 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Recording of the events a decoration receives, for bluecurve-replay.
+ */
+
+#include "bluecurvetrace.h"
+#include "bluecurverenderer.h"
+
+// Records buffered before the file is flushed, so a crashing twin
+// loses little of the trace
+#define TRACE_FLUSH_RECORDS 64
+
+namespace BlueCurve
+{
+
+static unsigned int traceGeneration = 0;
+
+TraceRecorder::TraceRecorder( const TQString& fileName )
+	: m_file( fileName ), m_generation( ++traceGeneration ), m_unflushed( 0 )
+{
+	if ( !m_file.open( IO_WriteOnly | IO_Truncate ) )
+		return;
+
+	m_stream.setDevice( &m_file );
+	m_stream << (TQ_UINT32) TRACE_MAGIC << (TQ_UINT32) TRACE_VERSION;
+	m_clock.start();
+}
+
+
+TraceRecorder::~TraceRecorder()
+{
+	if ( isOpen() )
+	{
+		m_stream.unsetDevice();
+		m_file.close();
+	}
+}
+
+
+void TraceRecorder::begin( int type, unsigned int id )
+{
+	m_stream << (TQ_UINT8) type << (TQ_UINT32) id << (TQ_UINT32) m_clock.elapsed();
+}
+
+
+void TraceRecorder::end()
+{
+	if ( ++m_unflushed >= TRACE_FLUSH_RECORDS )
+	{
+		m_file.flush();
+		m_unflushed = 0;
+	}
+}
+
+
+void TraceRecorder::geometry( unsigned int id, const DecorationState& s )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceGeometry, id );
+	m_stream << s.size << s.caption << (TQ_UINT8) s.active << (TQ_UINT8) s.tool
+		<< (TQ_INT16) s.titleHeight << s.titleRect
+		<< (TQ_UINT8) s.buttons.count();
+
+	TQValueList<DecorationButton>::ConstIterator it;
+	for ( it = s.buttons.begin(); it != s.buttons.end(); ++it )
+	{
+		const DecorationButton& b = *it;
+		m_stream << (TQ_INT8) b.glyph << (TQ_UINT8) b.pos << (TQ_UINT8) b.state
+			<< (TQ_UINT8) b.on << (TQ_UINT8) b.hidden << (TQ_UINT8) b.paint
+			<< b.rect;
+	}
+	end();
+}
+
+
+void TraceRecorder::resize( unsigned int id, const TQSize& size )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceResize, id );
+	m_stream << size;
+	end();
+}
+
+
+void TraceRecorder::caption( unsigned int id, const TQString& caption )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceCaption, id );
+	m_stream << caption;
+	end();
+}
+
+
+void TraceRecorder::active( unsigned int id, bool active )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceActive, id );
+	m_stream << (TQ_UINT8) active;
+	end();
+}
+
+
+void TraceRecorder::maximize( unsigned int id, int mode )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceMaximize, id );
+	m_stream << (TQ_UINT8) mode;
+	end();
+}
+
+
+void TraceRecorder::desktop( unsigned int id, bool onAllDesktops )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceDesktop, id );
+	m_stream << (TQ_UINT8) onAllDesktops;
+	end();
+}
+
+
+void TraceRecorder::hover( unsigned int id, int button )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceHover, id );
+	m_stream << (TQ_INT8) button;
+	end();
+}
+
+
+void TraceRecorder::press( unsigned int id, int button, int mouseButton )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TracePress, id );
+	m_stream << (TQ_INT8) button << (TQ_UINT8) mouseButton;
+	end();
+}
+
+
+void TraceRecorder::release( unsigned int id, int button, int mouseButton )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceRelease, id );
+	m_stream << (TQ_INT8) button << (TQ_UINT8) mouseButton;
+	end();
+}
+
+
+void TraceRecorder::expose( unsigned int id, const TQRegion& region )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceExpose, id );
+	m_stream << region;
+	end();
+}
+
+
+void TraceRecorder::buttonPaint( unsigned int id, int button )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceButtonPaint, id );
+	m_stream << (TQ_INT8) button;
+	end();
+}
+
+
+void TraceRecorder::destroy( unsigned int id )
+{
+	if ( !isOpen() )
+		return;
+
+	begin( TraceDestroy, id );
+	end();
+	m_file.flush();
+}
+
+}
+
+// vim: ts=4
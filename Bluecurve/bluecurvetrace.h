@@ -0,0 +1,90 @@
+/*
+ *	BlueCurve KWin client
+ *
+ *	Recording of the events a decoration receives, for bluecurve-replay.
+ */
+
+#ifndef _BLUECURVE_TRACE_H
+#define _BLUECURVE_TRACE_H
+
+#include <tqdatastream.h>
+#include <tqdatetime.h>
+#include <tqfile.h>
+#include <tqregion.h>
+
+namespace BlueCurve {
+
+struct DecorationState;
+
+// "BCTR", followed by the format version
+#define TRACE_MAGIC   0x42435452
+#define TRACE_VERSION 1
+
+/*
+ * Every record starts with the event type, the decoration's trace id and
+ * the time in ms since recording began:
+ *
+ *	TraceGeometry     size, caption, active, tool, title height, title rect
+ *	                  and the buttons as count, then glyph, pos, state, on,
+ *	                  hidden, paint and rect for each
+ *	TraceResize       size
+ *	TraceCaption      caption
+ *	TraceActive       active
+ *	TraceMaximize     maximize mode
+ *	TraceDesktop      on all desktops
+ *	TraceHover        button, or -1 when leaving the buttons
+ *	TracePress        button, mouse button
+ *	TraceRelease      button, mouse button
+ *	TraceExpose       region, as painted by the decoration widget
+ *	TraceButtonPaint  button, painted by its own widget
+ *	TraceDestroy
+ *
+ * Buttons are numbered in the order of the last TraceGeometry. A
+ * decoration's first record is always a TraceGeometry, also for windows
+ * which already existed when recording started.
+ */
+enum TraceEvent { TraceGeometry = 1, TraceResize, TraceCaption, TraceActive,
+	TraceMaximize, TraceDesktop, TraceHover, TracePress, TraceRelease,
+	TraceExpose, TraceButtonPaint, TraceDestroy, TraceEventCount };
+
+class TraceRecorder
+{
+	public:
+		TraceRecorder( const TQString& fileName );
+		~TraceRecorder();
+
+		bool isOpen() const { return m_file.isOpen(); }
+		TQString fileName() const { return m_file.name(); }
+
+		// Changes whenever a recorder is created, so decorations notice
+		// they have to describe themselves to a new trace
+		unsigned int generation() const { return m_generation; }
+
+		void geometry( unsigned int id, const DecorationState& s );
+		void resize( unsigned int id, const TQSize& size );
+		void caption( unsigned int id, const TQString& caption );
+		void active( unsigned int id, bool active );
+		void maximize( unsigned int id, int mode );
+		void desktop( unsigned int id, bool onAllDesktops );
+		void hover( unsigned int id, int button );
+		void press( unsigned int id, int button, int mouseButton );
+		void release( unsigned int id, int button, int mouseButton );
+		void expose( unsigned int id, const TQRegion& region );
+		void buttonPaint( unsigned int id, int button );
+		void destroy( unsigned int id );
+
+	private:
+		void begin( int type, unsigned int id );
+		void end();
+
+		TQFile        m_file;
+		TQDataStream  m_stream;
+		TQTime        m_clock;
+		unsigned int  m_generation;
+		int           m_unflushed;
+};
+
+}
+
+#endif
+// vim: ts=4
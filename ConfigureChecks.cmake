@@ -23,3 +23,24 @@ tde_setup_largefiles( )
 if( WITH_GCC_VISIBILITY )
   tde_setup_gcc_visibility( )
 endif( WITH_GCC_VISIBILITY )
+
+
+##### check for static tracepoint support
+
+if( WITH_SDT_PROBES )
+  check_include_file( "sys/sdt.h" HAVE_SYS_SDT_H )
+  if( NOT HAVE_SYS_SDT_H )
+    tde_message_fatal( "Static tracepoints are requested, but sys/sdt.h was not found (systemtap-sdt-dev)" )
+  endif( NOT HAVE_SYS_SDT_H )
+endif( WITH_SDT_PROBES )
+
+
+##### check for xrender
+
+if( WITH_XRENDER )
+  pkg_search_module( XRENDER xrender )
+  if( NOT XRENDER_FOUND )
+    tde_message_fatal( "Antialiased corners are requested, but xrender was not found" )
+  endif( NOT XRENDER_FOUND )
+  set( HAVE_XRENDER 1 )
+endif( WITH_XRENDER )
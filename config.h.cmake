@@ -6,3 +6,9 @@
 /* Define WORDS_BIGENDIAN to 1 if your processor stores words with the most
    significant byte first (like Motorola and SPARC, unlike Intel). */
 #cmakedefine WORDS_BIGENDIAN @WORDS_BIGENDIAN@
+
+/* Defined if static tracepoints are enabled and sys/sdt.h is available. */
+#cmakedefine HAVE_SYS_SDT_H 1
+
+/* Defined if antialiased corners are enabled and xrender is available. */
+#cmakedefine HAVE_XRENDER 1